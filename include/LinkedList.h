@@ -4,121 +4,184 @@
 #include "MPointer.h"
 #include "Node.h"
 #include <iostream>
+#include <typeinfo>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <iterator>
+#include <algorithm>
 
 // LinkedList template class
 template <typename T>
 class LinkedList {
+    struct Window;
+    
 public:
-    // Constructor
-    LinkedList() : headId(-1), tailId(-1), size(0) {
+    // Nodes read per LIST_TRAVERSE request while iterating
+    static constexpr size_t TRAVERSE_WINDOW_BYTES = 64 * 1024;
+    
+    // Nodes sent per LIST_APPEND request by assign()
+    static constexpr size_t ASSIGN_BATCH_BYTES = 1024 * 1024;
+    
+    // Read-only bidirectional iterator. Nodes are fetched a window at a time with
+    // LIST_TRAVERSE, and once the iterator moves forward inside a window the next one
+    // is requested in the background, so a full scan rarely waits for the network.
+    // Values are copies taken when their window was read: use set() to modify them.
+    // Inserting or removing nodes invalidates the iterators
+    class const_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+        
+        const_iterator() : listId(-1), position(0) {}
+        
+        reference operator*() const { return window->values[position]; }
+        pointer operator->() const { return &window->values[position]; }
+        
+        // ID of the current node, -1 at the end
+        int nodeId() const { return window ? window->ids[position] : -1; }
+        
+        const_iterator& operator++() {
+            window->prefetch(listId);
+            if (++position == window->ids.size()) {
+                enter(window->after != -1 ? window->next(listId) : nullptr, 0);
+            }
+            return *this;
+        }
+        
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        
+        const_iterator& operator--() {
+            if (listId == -1 || (window && position == 0 && window->before == -1)) {
+                // Nothing before the head (or no list yet): stepping back from begin() gives end()
+                enter(nullptr, 0);
+            } else if (!window || position == 0) {
+                // Read the window that ends right before this node (at the tail from the end).
+                // An empty list or window leaves the iterator at end()
+                std::shared_ptr<const Window> before = fetch(listId, window ? window->before : -1, true);
+                enter(before, before->ids.empty() ? 0 : before->ids.size() - 1);
+            } else {
+                position--;
+            }
+            return *this;
+        }
+        
+        const_iterator operator--(int) {
+            const_iterator previous = *this;
+            --*this;
+            return previous;
+        }
+        
+        bool operator==(const const_iterator& other) const { return nodeId() == other.nodeId(); }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+        
+    private:
+        friend class LinkedList;
+        
+        int listId;
+        std::shared_ptr<const Window> window;  // Shared by the copies of the iterator, null at the end
+        size_t position;
+        
+        const_iterator(int listId, std::shared_ptr<const Window> first) : listId(listId), position(0) {
+            enter(std::move(first), 0);
+        }
+        
+        void enter(std::shared_ptr<const Window> next, size_t index) {
+            window = next && !next->ids.empty() ? std::move(next) : nullptr;
+            position = index;
+        }
+    };
+    
+    using iterator = const_iterator;
+    
+    // Constructor (the list is created in Memory Manager on the first insertion)
+    LinkedList() : listId(-1), headId(-1), tailId(-1), size(0), indexed(true) {
         std::cout << "LinkedList created" << std::endl;
     }
     
+    // Build the list from a range of values
+    template <typename InputIt>
+    LinkedList(InputIt first, InputIt last) : LinkedList() {
+        assign(first, last);
+    }
+    
+    // A list owns its nodes, it can't be copied
+    LinkedList(const LinkedList&) = delete;
+    LinkedList& operator=(const LinkedList&) = delete;
+    
     // Destructor
     ~LinkedList() {
         // Clear all nodes
         clear();
+        
+        // Release the list handle
+        if (listId != -1 && MemoryManagerClient::IsInitialized()) {
+            MemoryManagerClient::DecreaseRefCount(listId);
+        }
     }
     
     // Add element to the back of the list
     void pushBack(const T& value) {
-        // Create a new node
-        MPointer<Node<T>> newNode = MPointer<Node<T>>::New();
-        std::cout << "Created new node with ID: " << newNode.getId() << std::endl;
-        
-        // Debug print
-        std::cout << "Before setting data, node.data = " << newNode->data << std::endl;
-
-        // Create a complete Node with all fields properly initialized
-        Node<T> tempNode;
-        tempNode.data = value;  // Set the value
-        tempNode.nextId = -1;   // Initialize links
-        tempNode.prevId = -1;
-        
-        // Directly set the entire node to ensure proper memory layout
-        if (!MemoryManagerClient::Set(newNode.getId(), &tempNode, sizeof(Node<T>))) {
-            throw std::runtime_error("Failed to set node data");
-        }
-        
-        // Debug verification - retrieve and check the node
-        Node<T> verifyNode;
-        if (MemoryManagerClient::Get(newNode.getId(), &verifyNode, sizeof(Node<T>))) {
-            std::cout << "Verification - node data: " << verifyNode.data << std::endl;
-            debugPrintMemory(&verifyNode, sizeof(Node<T>), "Retrieved node");
+        // Memory Manager creates the node and links it to the tail in a single request.
+        // The node belongs to the list until it is popped
+        Node<T> newNode;
+        setNodeData(newNode, value);
+        int oldTail = tailId;
+        
+        Protocol::ListState state;
+        int newId = MemoryManagerClient::ListPushBack(handle(), &newNode, sizeof(Node<T>), state);
+        if (newId == -1) {
+            throw std::runtime_error("Failed to create list node");
         }
+        std::cout << "Created new node with ID: " << newId << std::endl;
         
-        // First element case
-        if (headId == -1) {
-            // This is the first element
-            headId = newNode.getId();
-            tailId = newNode.getId();
+        // Append to the index only if nobody else changed the list since our last request
+        bool inPlace = indexed && state.tail == newId && state.count == static_cast<uint32_t>(size) + 1;
+        update(state);
+        if (inPlace) {
+            nodeIds.push_back(newId);
         } else {
-            // Add to the end of the list
-            MPointer<Node<T>> tailNode = getNodeById(tailId);
-            if (tailNode.getId() != -1) {
-                // Create temp nodes for updating links
-                Node<T> updatedNewNode;
-                MemoryManagerClient::Get(newNode.getId(), &updatedNewNode, sizeof(Node<T>));
-                updatedNewNode.prevId = tailId;
-                updatedNewNode.nextId = -1;
-                MemoryManagerClient::Set(newNode.getId(), &updatedNewNode, sizeof(Node<T>));
-                
-                Node<T> updatedTailNode;
-                MemoryManagerClient::Get(tailId, &updatedTailNode, sizeof(Node<T>));
-                updatedTailNode.nextId = newNode.getId();
-                MemoryManagerClient::Set(tailId, &updatedTailNode, sizeof(Node<T>));
-                
-                tailId = newNode.getId();
-            }
+            indexed = false;
+        }
+        if (oldTail != -1) {
+            MemoryManagerClient::InvalidateCache(oldTail);  // Its link changed on the server
         }
-        
-        size++;
         std::cout << "Added element to back: " << value << ", size now: " << size << std::endl;
     }
     
     // Add element to the front of the list
     void pushFront(const T& value) {
-        // Create a new node
-        MPointer<Node<T>> newNode = MPointer<Node<T>>::New();
-        std::cout << "Created new node with ID: " << newNode.getId() << std::endl;
-        
-        // Create a complete Node with all fields properly initialized
-        Node<T> tempNode;
-        tempNode.data = value;  // Set the value
-        tempNode.nextId = -1;   // Initialize links
-        tempNode.prevId = -1;
-        
-        // Directly set the entire node to ensure proper memory layout
-        if (!MemoryManagerClient::Set(newNode.getId(), &tempNode, sizeof(Node<T>))) {
-            throw std::runtime_error("Failed to set node data");
+        Node<T> newNode;
+        setNodeData(newNode, value);
+        int oldHead = headId;
+        
+        Protocol::ListState state;
+        int newId = MemoryManagerClient::ListPushFront(handle(), &newNode, sizeof(Node<T>), state);
+        if (newId == -1) {
+            throw std::runtime_error("Failed to create list node");
         }
+        std::cout << "Created new node with ID: " << newId << std::endl;
         
-        // First element case
-        if (headId == -1) {
-            // This is the first element
-            headId = newNode.getId();
-            tailId = newNode.getId();
+        bool inPlace = indexed && state.head == newId && state.count == static_cast<uint32_t>(size) + 1;
+        update(state);
+        if (inPlace) {
+            nodeIds.push_front(newId);
         } else {
-            // Add to the beginning of the list
-            MPointer<Node<T>> headNode = getNodeById(headId);
-            if (headNode.getId() != -1) {
-                // Create temp nodes for updating links
-                Node<T> updatedNewNode;
-                MemoryManagerClient::Get(newNode.getId(), &updatedNewNode, sizeof(Node<T>));
-                updatedNewNode.nextId = headId;
-                updatedNewNode.prevId = -1;
-                MemoryManagerClient::Set(newNode.getId(), &updatedNewNode, sizeof(Node<T>));
-                
-                Node<T> updatedHeadNode;
-                MemoryManagerClient::Get(headId, &updatedHeadNode, sizeof(Node<T>));
-                updatedHeadNode.prevId = newNode.getId();
-                MemoryManagerClient::Set(headId, &updatedHeadNode, sizeof(Node<T>));
-                
-                headId = newNode.getId();
-            }
+            indexed = false;
+        }
+        if (oldHead != -1) {
+            MemoryManagerClient::InvalidateCache(oldHead);  // Its link changed on the server
         }
-        
-        size++;
         std::cout << "Added element to front: " << value << ", size now: " << size << std::endl;
     }
     
@@ -128,119 +191,126 @@ public:
             return false; // List is empty
         }
         
-        // Get a copy of the head node
-        Node<T> headNode;
-        if (!MemoryManagerClient::Get(headId, &headNode, sizeof(Node<T>))) {
-            return false; // Failed to get head node
+        // Memory Manager unlinks and releases the head node in a single request
+        Protocol::ListState state;
+        int removedId = MemoryManagerClient::ListPopFront(listId, state);
+        if (removedId == -1) {
+            return false;
         }
         
-        int nextId = headNode.nextId;
-        
-        // Update next node's prev pointer if there is a next node
-        if (nextId != -1) {
-            Node<T> nextNode;
-            if (MemoryManagerClient::Get(nextId, &nextNode, sizeof(Node<T>))) {
-                nextNode.prevId = -1;
-                MemoryManagerClient::Set(nextId, &nextNode, sizeof(Node<T>));
-            }
+        bool inPlace = indexed && !nodeIds.empty() && nodeIds.front() == removedId &&
+                       state.count + 1 == static_cast<uint32_t>(size);
+        update(state);
+        if (inPlace) {
+            nodeIds.pop_front();
+        } else {
+            indexed = false;
         }
-        
-        // If this was the only element, update tailId
-        if (tailId == headId) {
-            tailId = -1;
+        if (headId != -1) {
+            MemoryManagerClient::InvalidateCache(headId);  // Its link changed on the server
         }
-        
-        // Update headId to the next node
-        int oldHeadId = headId;
-        headId = nextId;
-        
-        // Decrease reference count for the node being removed
-        MemoryManagerClient::DecreaseRefCount(oldHeadId);
-        
-        size--;
         return true;
     }
     
-    // Get value at index
-    bool get(int index, T& value) {
-        if (index < 0 || index >= size) {
-            return false;
-        }
+    // Replace the contents with a range of values. The nodes are sent in bulk with
+    // LIST_APPEND, which creates and links many of them in a single request
+    template <typename InputIt>
+    void assign(InputIt first, InputIt last) {
+        clear();
         
-        // Get a copy of the node at the given index
         Node<T> node;
-        int nodeId = headId;
-        
-        for (int i = 0; i < index; i++) {
-            if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<T>))) {
-                return false;
+        std::vector<char> nodes;
+        std::vector<int> ids;
+        while (first != last) {
+            nodes.clear();
+            for (; first != last && nodes.size() < ASSIGN_BATCH_BYTES; ++first) {
+                T value = *first;
+                setNodeData(node, value);
+                const char* bytes = reinterpret_cast<const char*>(&node);
+                nodes.insert(nodes.end(), bytes, bytes + sizeof(Node<T>));
             }
             
-            // If we reach the end unexpectedly, return false
-            if (node.nextId == -1) {
-                return false;
+            size_t count = nodes.size() / sizeof(Node<T>);
+            int oldTail = tailId;
+            Protocol::ListState state;
+            if (MemoryManagerClient::ListAppend(handle(), nodes.data(), sizeof(Node<T>), count, ids, state) == -1) {
+                throw std::runtime_error("Failed to create list nodes");
             }
             
-            nodeId = node.nextId;
+            bool inPlace = indexed && state.tail == ids.back() && state.count == static_cast<uint32_t>(size) + count;
+            update(state);
+            if (inPlace) {
+                nodeIds.insert(nodeIds.end(), ids.begin(), ids.end());
+            } else {
+                indexed = false;
+            }
+            if (oldTail != -1) {
+                MemoryManagerClient::InvalidateCache(oldTail);  // Its link changed on the server
+            }
+        }
+        std::cout << "Assigned " << size << " elements" << std::endl;
+    }
+    
+    // Get value at index (a single request, the node ID comes from the index)
+    bool get(int index, T& value) {
+        int nodeId = nodeAt(index);
+        if (nodeId == -1) {
+            return false;
         }
         
-        // Get the node at the final index
+        Node<T> node;
         if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<T>))) {
+            indexed = false;  // The node is gone, rebuild the index next time
             return false;
         }
         
-        value = node.data;
+        value = getNodeData(node);
         return true;
     }
     
-    // Set value at index
+    // Set value at index (a single request that writes the data and leaves the links alone)
     bool set(int index, const T& value) {
-        if (index < 0 || index >= size) {
+        int nodeId = nodeAt(index);
+        if (nodeId == -1) {
             return false;
         }
         
-        // Find the node at the given index
-        int nodeId = headId;
         Node<T> node;
-        
-        for (int i = 0; i < index; i++) {
-            if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<T>))) {
-                return false;
-            }
-            
-            // If we reach the end unexpectedly, return false
-            if (node.nextId == -1) {
-                return false;
-            }
-            
-            nodeId = node.nextId;
-        }
-        
-        // Get the node, update its data, and set it back
-        if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<T>))) {
-            return false;
-        }
-        
-        node.data = value;
-        
-        if (!MemoryManagerClient::Set(nodeId, &node, sizeof(Node<T>))) {
+        setNodeData(node, value);
+        if (!MemoryManagerClient::SetRange(nodeId, 0, &node, offsetof(Node<T>, nextId))) {
+            indexed = false;
             return false;
         }
         
         return true;
     }
     
-    // Clear the list
+    // Clear the list (Memory Manager releases every node in a single request)
     void clear() {
-        // For safety, handle each node individually
-        while (headId != -1) {
-            popFront();
+        Protocol::ListState state;
+        if (listId != -1 && MemoryManagerClient::IsInitialized() &&
+            MemoryManagerClient::ListClear(listId, state) == -1) {
+            std::cerr << "Failed to clear list " << listId << std::endl;
+        }
+        for (int nodeId : nodeIds) {
+            MemoryManagerClient::InvalidateCache(nodeId);
         }
         
         // Reset list state
         headId = -1;
         tailId = -1;
         size = 0;
+        nodeIds.clear();
+        indexed = true;
+    }
+    
+    // Iteration from the current head of the list in Memory Manager
+    const_iterator begin() const {
+        return listId == -1 ? end() : const_iterator(listId, fetch(listId, -1, false));
+    }
+    
+    const_iterator end() const {
+        return const_iterator(listId, nullptr);  // Keeps the list so it can be decremented
     }
     
     // Print the list
@@ -253,214 +323,148 @@ public:
         std::cout << "List [" << size << "]" << std::endl;
         
         int nodeCount = 0;
-        int currentId = headId;
-        
-        while (currentId != -1 && nodeCount < size) {
-            Node<T> node;
-            if (!MemoryManagerClient::Get(currentId, &node, sizeof(Node<T>))) {
-                std::cerr << "Error: Failed to get node with ID " << currentId << std::endl;
-                break;
-            }
-            
-            std::cout << "  " << nodeCount << ": " << node.data << std::endl;
-            
-            // Move to next node
-            currentId = node.nextId;
-            nodeCount++;
-            
-            // Safety check to prevent infinite loops
-            if (nodeCount > size) {
-                std::cerr << "Warning: List structure corrupted - more nodes than expected" << std::endl;
-                break;
-            }
+        for (const T& value : *this) {
+            std::cout << "  " << nodeCount++ << ": " << value << std::endl;
         }
     }
 
 private:
+    int listId;  // ID of the list handle in Memory Manager, -1 until the first insertion
     int headId;  // ID of the head node
     int tailId;  // ID of the tail node
     int size;    // Number of elements in the list
     
-    // Helper method to get a node by ID
-    MPointer<Node<T>> getNodeById(int id) {
-        if (id == -1) {
-            return MPointer<Node<T>>();  // Return null MPointer
-        }
-        
-        // Create a temporary MPointer with the given ID
-        MPointer<Node<T>> nodePtr;
-        nodePtr.id = id;  // Direct access to private member via friend declaration
-        
-        // Increase reference count
-        if (!MemoryManagerClient::IsInitialized()) {
-            std::cerr << "MemoryManagerClient not initialized" << std::endl;
-            return MPointer<Node<T>>(); // Return null MPointer
-        }
-        
-        if (!MemoryManagerClient::IncreaseRefCount(id)) {
-            std::cerr << "Failed to increase reference count for node " << id << std::endl;
-            return MPointer<Node<T>>(); // Return null MPointer
-        }
-        
-        return nodePtr;
-    }
-};
-
-// Specialization for std::string
-template<>
-void LinkedList<std::string>::pushBack(const std::string& value) {
-    // Create a new node
-    MPointer<Node<std::string>> newNode = MPointer<Node<std::string>>::New();
-    std::cout << "Created string node with ID: " << newNode.getId() << std::endl;
-    
-    // Create a complete Node with all fields properly initialized
-    Node<std::string> tempNode;
-    tempNode.setData(value);  // Use the helper method
-    tempNode.nextId = -1;
-    tempNode.prevId = -1;
-    
-    // Directly set the entire node
-    if (!MemoryManagerClient::Set(newNode.getId(), &tempNode, sizeof(Node<std::string>))) {
-        throw std::runtime_error("Failed to set string node data");
-    }
-    
-    // Debug verification
-    Node<std::string> verifyNode;
-    if (MemoryManagerClient::Get(newNode.getId(), &verifyNode, sizeof(Node<std::string>))) {
-        std::cout << "Verification - string node data: '" << verifyNode.getData() << "'" << std::endl;
-    }
+    // Node IDs in list order, kept up to date by push/pop so get/set don't walk the list.
+    // If a push or pop returns a state we didn't expect (another client changed the list)
+    // the index is dropped and rebuilt on the next indexed access
+    std::deque<int> nodeIds;
+    bool indexed;
     
-    // First element case
-    if (headId == -1) {
-        // This is the first element
-        headId = newNode.getId();
-        tailId = newNode.getId();
-    } else {
-        // Add to the end of the list
-        MPointer<Node<std::string>> tailNode = getNodeById(tailId);
-        if (tailNode.getId() != -1) {
-            // Update links using temp nodes
-            Node<std::string> updatedNewNode;
-            MemoryManagerClient::Get(newNode.getId(), &updatedNewNode, sizeof(Node<std::string>));
-            updatedNewNode.prevId = tailId;
-            updatedNewNode.nextId = -1;
-            MemoryManagerClient::Set(newNode.getId(), &updatedNewNode, sizeof(Node<std::string>));
-            
-            Node<std::string> updatedTailNode;
-            MemoryManagerClient::Get(tailId, &updatedTailNode, sizeof(Node<std::string>));
-            updatedTailNode.nextId = newNode.getId();
-            MemoryManagerClient::Set(tailId, &updatedTailNode, sizeof(Node<std::string>));
-            
-            tailId = newNode.getId();
+    // Create the list in Memory Manager if it doesn't exist yet
+    int handle() {
+        if (listId == -1) {
+            listId = MemoryManagerClient::ListCreate(sizeof(Node<T>), offsetof(Node<T>, nextId),
+                                                     offsetof(Node<T>, prevId), typeid(Node<T>).name());
+            if (listId == -1) {
+                throw std::runtime_error("Failed to create list");
+            }
         }
+        return listId;
     }
     
-    size++;
-    std::cout << "Added string element to back: '" << value << "', size now: " << size << std::endl;
-}
-
-// Specialization for std::string to handle proper printing
-template<>
-void LinkedList<std::string>::print() {
-    if (headId == -1) {
-        std::cout << "List [empty]" << std::endl;
-        return;
+    // Mirror the state Memory Manager returned
+    void update(const Protocol::ListState& state) {
+        headId = state.head;
+        tailId = state.tail;
+        size = static_cast<int>(state.count);
     }
     
-    std::cout << "List [" << size << "]" << std::endl;
-    
-    int nodeCount = 0;
-    int currentId = headId;
-    
-    while (currentId != -1 && nodeCount < size) {
-        Node<std::string> node;
-        if (!MemoryManagerClient::Get(currentId, &node, sizeof(Node<std::string>))) {
-            std::cerr << "Error: Failed to get string node with ID " << currentId << std::endl;
-            break;
+    // A run of consecutive nodes read with one LIST_TRAVERSE, in list order
+    struct Window {
+        std::vector<int> ids;
+        std::vector<T> values;
+        int before = -1;  // Node before the first one, -1 at the head
+        int after = -1;   // Node after the last one, -1 at the tail
+        
+        // The window that follows, requested in the background by prefetch()
+        mutable std::once_flag prefetched;
+        mutable std::shared_future<std::shared_ptr<const Window>> following;
+        
+        void prefetch(int listId) const {
+            if (after != -1) {
+                std::call_once(prefetched, [&] {
+                    following = std::async(std::launch::async, &LinkedList::fetch, listId, after, false).share();
+                });
+            }
         }
         
-        std::cout << "  " << nodeCount << ": \"" << node.getData() << "\"" << std::endl;
-        
-        // Move to next node
-        currentId = node.nextId;
-        nodeCount++;
-        
-        // Safety check to prevent infinite loops
-        if (nodeCount > size) {
-            std::cerr << "Warning: List structure corrupted - more nodes than expected" << std::endl;
-            break;
+        std::shared_ptr<const Window> next(int listId) const {
+            prefetch(listId);
+            return following.get();
         }
-    }
-}
-
-// Additional string specializations for other methods
-template<>
-bool LinkedList<std::string>::get(int index, std::string& value) {
-    if (index < 0 || index >= size) {
-        return false;
-    }
-    
-    // Find the node at the given index
-    int nodeId = headId;
-    Node<std::string> node;
+    };
     
-    for (int i = 0; i < index; i++) {
-        if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<std::string>))) {
-            return false;
+    // Read the window that starts at `startId` (or ends there, going backward)
+    static std::shared_ptr<const Window> fetch(int listId, int startId, bool backward) {
+        const size_t nodeSize = sizeof(Node<T>);
+        std::vector<int> ids;
+        std::vector<char> nodes;
+        int count = MemoryManagerClient::ListTraverse(listId, startId, backward,
+                                                      std::max<size_t>(1, TRAVERSE_WINDOW_BYTES / nodeSize),
+                                                      nodeSize, ids, nodes);
+        if (count == -1) {
+            throw std::runtime_error("Failed to traverse list");
         }
         
-        // If we reach the end unexpectedly, return false
-        if (node.nextId == -1) {
-            return false;
+        auto window = std::make_shared<Window>();
+        std::vector<std::pair<int, int>> links;  // Previous and next node of each one
+        Node<T> node;
+        for (int i = 0; i < count; i++) {
+            memcpy(static_cast<void*>(&node), nodes.data() + i * nodeSize, nodeSize);
+            window->values.push_back(getNodeData(node));
+            links.push_back({node.prevId, node.nextId});
         }
+        window->ids = std::move(ids);
         
-        nodeId = node.nextId;
-    }
-    
-    // Get the node at the final index
-    if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<std::string>))) {
-        return false;
+        if (backward) {
+            std::reverse(window->ids.begin(), window->ids.end());
+            std::reverse(window->values.begin(), window->values.end());
+            std::reverse(links.begin(), links.end());
+        }
+        if (count > 0) {
+            window->before = links.front().first;
+            window->after = links.back().second;
+        }
+        return window;
     }
     
-    value = node.getData();
-    return true;
-}
-
-template<>
-bool LinkedList<std::string>::set(int index, const std::string& value) {
-    if (index < 0 || index >= size) {
-        return false;
+    // ID of the node at `index`, -1 if out of range or the list can't be walked
+    int nodeAt(int index) {
+        if (index < 0 || index >= size) {
+            return -1;
+        }
+        if (!indexed && !rebuildIndex()) {
+            return -1;
+        }
+        return index < size ? nodeIds[index] : -1;  // The rebuilt list may be shorter
     }
     
-    // Find the node at the given index
-    int nodeId = headId;
-    Node<std::string> node;
-    
-    for (int i = 0; i < index; i++) {
-        if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<std::string>))) {
-            return false;
-        }
-        
-        // If we reach the end unexpectedly, return false
-        if (node.nextId == -1) {
+    // Read the node IDs in bulk with LIST_TRAVERSE. What the server has is taken as
+    // the current state of the list, changes made by other clients included
+    bool rebuildIndex() {
+        nodeIds.clear();
+        try {
+            for (auto it = begin(); it != end(); ++it) {
+                nodeIds.push_back(it.nodeId());
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Failed to rebuild the list index: " << e.what() << std::endl;
+            nodeIds.clear();
             return false;
         }
         
-        nodeId = node.nextId;
+        headId = nodeIds.empty() ? -1 : nodeIds.front();
+        tailId = nodeIds.empty() ? -1 : nodeIds.back();
+        size = static_cast<int>(nodeIds.size());
+        indexed = true;
+        return true;
     }
-    
-    // Get the node, update its data, and set it back
-    if (!MemoryManagerClient::Get(nodeId, &node, sizeof(Node<std::string>))) {
-        return false;
+};
+
+// Specialization for std::string to handle proper printing
+template<>
+void LinkedList<std::string>::print() {
+    if (headId == -1) {
+        std::cout << "List [empty]" << std::endl;
+        return;
     }
     
-    node.setData(value);
+    std::cout << "List [" << size << "]" << std::endl;
     
-    if (!MemoryManagerClient::Set(nodeId, &node, sizeof(Node<std::string>))) {
-        return false;
+    int nodeCount = 0;
+    for (const std::string& value : *this) {
+        std::cout << "  " << nodeCount++ << ": \"" << value << "\"" << std::endl;
     }
-    
-    return true;
 }
 
 #endif // LINKED_LIST_H
\ No newline at end of file
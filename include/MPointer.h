@@ -3,41 +3,36 @@
 
 #include <string>
 #include <memory>
+#include <utility>
+#include <type_traits>
 #include <typeinfo>
 #include <cstdint>
 #include <stdexcept>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <cstring>
+#include <cstddef>
 #include <iostream>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
 
 #include "Node.h" // Include the Node definition
+#include "Protocol.h"
 
 // Forward declarations
 template <typename T>
 class MPointer;
 
-// Message types for communication with Memory Manager
-enum class MessageType : uint8_t {
-    CREATE = 1,
-    SET = 2,
-    GET = 3,
-    INCREASE_REF_COUNT = 4,
-    DECREASE_REF_COUNT = 5
-};
-
-// Structure for messages sent to the Memory Manager
-struct Message {
-    MessageType type;
-    int id;
-    size_t size;
-    char typeStr[32];  // For storing type name
-    char data[1024];   // For data (adjust size as needed)
-};
-
 // Client for Memory Manager communication
 class MemoryManagerClient {
 public:
@@ -47,17 +42,176 @@ public:
     static int Create(size_t size, const std::string& type);
     static bool Set(int id, const void* value, size_t size);
     static bool Get(int id, void* value, size_t size);
+    static bool SetRange(int id, size_t offset, const void* value, size_t size);  // Writes part of a block
+    static bool GetRange(int id, size_t offset, void* value, size_t size);        // Reads part of a block (never cached)
     static bool IncreaseRefCount(int id);
     static bool DecreaseRefCount(int id);
+    
+    // Lists kept by the Memory Manager (see Protocol.h): each call is a single round
+    // trip and `state` receives the head, tail and length of the list after it
+    static int ListCreate(size_t nodeSize, size_t nextOffset, size_t prevOffset, const std::string& nodeType);
+    static int ListPushBack(int listId, const void* node, size_t size, Protocol::ListState& state);   // ID of the new node
+    static int ListPushFront(int listId, const void* node, size_t size, Protocol::ListState& state);  // ID of the new node
+    static int ListPopFront(int listId, Protocol::ListState& state);  // ID of the node removed (the server releases it)
+    static int ListClear(int listId, Protocol::ListState& state);     // Number of nodes released
+    
+    // Adds `count` nodes of `nodeSize` bytes, stored one after the other in `nodes`, at
+    // the back of the list in one request. Their IDs go to `ids`. Returns `count`, -1 on failure
+    static int ListAppend(int listId, const void* nodes, size_t nodeSize, size_t count,
+                          std::vector<int>& ids, Protocol::ListState& state);
+    
+    // Reads up to `maxNodes` consecutive nodes of `nodeSize` bytes starting at `startId`
+    // (-1 = the head, or the tail when `backward`) in a single round trip. Their IDs go
+    // to `ids` and their contents, one after the other, to `nodes`. Returns the number
+    // of nodes read, -1 on failure
+    static int ListTraverse(int listId, int startId, bool backward, size_t maxNodes, size_t nodeSize,
+                            std::vector<int>& ids, std::vector<char>& nodes);
+    
+    static bool RequestDump();      // Asks the Memory Manager to write a memory dump
+    static bool RequestSnapshot();  // Asks the Memory Manager to save its binary snapshot
     static bool IsInitialized() { return initialized; }
+    
+    // Local reference tally used by MPointer. The process holds a single server
+    // reference per ID while any of its MPointers does, so copies cost no traffic.
+    // Releases are deferred and sent together in one batch, when enough of them
+    // are pending, REF_FLUSH_INTERVAL after the last flush (a background thread
+    // sends them even if the process does nothing else), or on
+    // FlushReferences()/Cleanup(). A release still pending when the ID is retained
+    // again is simply cancelled. Releases the server never got are retried on the
+    // next flush
+    static bool RetainReference(int id);  // Another local holder; contacts the server only for the first one
+    static void AdoptReference(int id);   // First local holder of a block this process just created
+    static void ReleaseReference(int id); // A local holder is gone
+    static bool FlushReferences();        // Send the pending releases now
+    
+    static constexpr size_t REF_FLUSH_THRESHOLD = 64;
+    static constexpr std::chrono::milliseconds REF_FLUSH_INTERVAL{100};
+    
+    // Read-through cache of block values, validated with the block version the
+    // server sends along with every value. Writes of this process go through it
+    enum class CacheMode {
+        OFF,      // Every read fetches the value
+        STRICT,   // Every read asks the server, an unchanged value isn't sent again (default)
+        SESSION,  // Cached values are served locally: this process sees its own writes,
+                  // other clients' writes only after InvalidateCache()
+        TTL       // Served locally for `ttl` after the server last confirmed them, then like STRICT
+    };
+    static void SetCacheMode(CacheMode mode, std::chrono::milliseconds ttl = std::chrono::milliseconds(100));
+    static void InvalidateCache(int id = -1);  // Forget one cached value, or all of them
+    
+    static constexpr size_t MAX_CACHED_VALUE = Protocol::STREAM_THRESHOLD;  // Larger values are never cached
+    static constexpr size_t MAX_CACHE_BYTES = 16 * 1024 * 1024;             // The cache is emptied when it would grow past this
 
 private:
-    static int clientSocket;
+    friend class RequestBatch;
+    
+    struct CachedValue {
+        uint64_t version;
+        std::vector<char> data;
+        std::chrono::steady_clock::time_point validated;  // Last time the server confirmed it
+    };
+    
+    static std::mutex cacheMutex;
+    static std::unordered_map<int, CachedValue> cache;
+    static size_t cacheBytes;
+    static std::atomic<CacheMode> cacheMode;
+    static std::chrono::milliseconds cacheTtl;
+    
+    static bool getCached(int id, void* value, size_t size);
+    static int listRequest(MessageType type, int id, size_t size, const void* payload, size_t payloadLength,
+                           Protocol::ListState& state);
+    static void storeCached(int id, uint64_t version, const void* value, size_t size);
+    
+    static std::mutex refMutex;  // Held while the tally changes and while releases are sent
+    static std::unordered_map<int, int> localRefs;   // ID -> MPointers of this process holding it
+    static std::unordered_set<int> pendingReleases;  // IDs whose server reference goes on the next flush
+    static std::chrono::steady_clock::time_point lastRefFlush;
+    
+    // Background thread that flushes the releases left pending for REF_FLUSH_INTERVAL.
+    // Stopped by Cleanup(), or when the program exits
+    struct RefFlusher {
+        std::thread thread;
+        bool stopping = false;  // Guarded by refMutex
+        
+        void start();
+        void stop();
+        ~RefFlusher() { stop(); }
+    };
+    static std::condition_variable refCondition;  // Wakes the flusher
+    static RefFlusher refFlusher;
+    
+    static bool flushReferencesLocked();
+    static void flushPendingReferences();
+    
+    static int clientSocket;       // Persistent connection, reused by every request
+    static std::mutex socketMutex; // Serializes request/response pairs on clientSocket
     static std::string host;
     static int port;
     static std::atomic<bool> initialized;
     
-    static bool sendMessage(const Message& message, Message& response);
+    // Sends one request and waits for its response. The response payload is read
+    // straight into responseData (up to responseCapacity bytes). A request is only
+    // sent again when the server can't have run it twice: the frame was never fully
+    // written, or the request only reads. `sent` tells whether the frame reached the
+    // server, i.e. whether a failed request may still have run
+    static bool sendRequest(const Protocol::Header& request, const void* payload,
+                            Protocol::Header& response, void* responseData = nullptr,
+                            size_t responseCapacity = 0, bool* sent = nullptr);
+    static bool connectToServer();
+    static bool connectionClosed(int socket);  // The server hung up (or the socket failed)
+    static void disconnect();
+};
+
+// Queues requests and sends them to the Memory Manager in a single round trip.
+// Requests are served in the order they were queued; after Execute() the
+// result of each one can be read with the index its queueing method returned
+class RequestBatch {
+public:
+    size_t Create(size_t size, const std::string& type);
+    size_t Set(int id, const void* value, size_t size);  // The value is copied into the batch
+    size_t SetCreated(size_t createIndex, const void* value, size_t size);  // Sets the block created by an earlier Create
+    size_t Get(int id, void* value, size_t size);  // `value` is filled in by Execute()
+    size_t SetRange(int id, size_t offset, const void* value, size_t size);
+    size_t GetRange(int id, size_t offset, void* value, size_t size);
+    size_t IncreaseRefCount(int id);
+    size_t DecreaseRefCount(int id);
+    
+    // Sends every queued request, returns true if all of them succeeded
+    bool Execute();
+    
+    int Result(size_t index) const { return results[index]; }  // ID returned, -1 on failure
+    bool Sent() const { return sent; }  // The batch reached the server (its requests may have run even if Execute failed)
+    bool Succeeded(size_t index) const { return results[index] != -1; }
+    size_t Size() const { return entries.size(); }
+    bool Empty() const { return entries.empty(); }
+    void Clear();
+    
+private:
+    struct Entry {
+        void* output;       // Destination of a GET value
+        size_t outputSize;
+        int written = -1;   // Block a SET changes (its cached value is dropped)
+    };
+    
+    std::vector<char> payload;  // Encoded request frames
+    std::vector<Entry> entries;
+    std::vector<int> results;
+    bool sent = false;
+    
+    size_t queue(Protocol::Header header, const void* data, void* output = nullptr, size_t outputSize = 0);
+};
+
+// Flushes the pending reference releases when it goes out of scope
+class ReferenceScope {
+public:
+    ReferenceScope() = default;
+    ReferenceScope(const ReferenceScope&) = delete;
+    ReferenceScope& operator=(const ReferenceScope&) = delete;
+    ~ReferenceScope() {
+        if (MemoryManagerClient::IsInitialized()) {
+            MemoryManagerClient::FlushReferences();
+        }
+    }
 };
 
 // MPointer template class
@@ -65,39 +219,56 @@ template <typename T>
 class MPointer {
 public:
     // Default constructor
-    MPointer() : id(-1), valuePtr(nullptr) {}
+    MPointer() : id(-1) {}
     
-    // Destructor
+    // Destructor (the server reference is released once no local copy is left)
     ~MPointer() {
         if (id != -1 && MemoryManagerClient::IsInitialized()) {
-            MemoryManagerClient::DecreaseRefCount(id);
+            MemoryManagerClient::ReleaseReference(id);
         }
     }
     
-    // Copy constructor
-    MPointer(const MPointer<T>& other) : id(other.id), valuePtr(nullptr) {
+    // Copy constructor (only the local tally changes)
+    MPointer(const MPointer<T>& other) : id(other.id) {
         if (id != -1 && MemoryManagerClient::IsInitialized()) {
-            MemoryManagerClient::IncreaseRefCount(id);
+            MemoryManagerClient::RetainReference(id);
         }
     }
     
     // Assignment operator
     MPointer<T>& operator=(const MPointer<T>& other) {
         if (this != &other) {
+            // Retain first, in case both point to the same block
+            if (other.id != -1 && MemoryManagerClient::IsInitialized()) {
+                MemoryManagerClient::RetainReference(other.id);
+            }
             if (id != -1 && MemoryManagerClient::IsInitialized()) {
-                MemoryManagerClient::DecreaseRefCount(id);
+                MemoryManagerClient::ReleaseReference(id);
             }
             
             id = other.id;
-            valuePtr = nullptr;
-            
-            if (id != -1 && MemoryManagerClient::IsInitialized()) {
-                MemoryManagerClient::IncreaseRefCount(id);
-            }
         }
         return *this;
     }
     
+    // Move constructor (the reference changes hands, nothing is sent)
+    MPointer(MPointer<T>&& other) noexcept : id(other.id) {
+        other.id = -1;
+    }
+    
+    // Move assignment (the reference held before is released like in the destructor)
+    MPointer<T>& operator=(MPointer<T>&& other) noexcept {
+        if (this != &other) {
+            MPointer<T> released(std::move(*this));
+            swap(other);
+        }
+        return *this;
+    }
+    
+    void swap(MPointer<T>& other) noexcept {
+        std::swap(id, other.id);
+    }
+    
     // Static initialization method
     static void Init(int port, const std::string& host = "127.0.0.1") {
         MemoryManagerClient::Init(port, host);
@@ -113,9 +284,6 @@ public:
             throw std::runtime_error("Failed to allocate memory in Memory Manager");
         }
         
-        // Set the ID
-        ptr.id = id;
-        
         // Initialize with default constructor value
         T defaultValue = T();
         if (!MemoryManagerClient::Set(id, &defaultValue, sizeof(T))) {
@@ -124,90 +292,211 @@ public:
             throw std::runtime_error("Failed to initialize memory in Memory Manager");
         }
         
+        // The reference returned by CREATE becomes the one this process holds
+        ptr.id = id;
+        MemoryManagerClient::AdoptReference(id);
+        
         return ptr;
     }
     
-    // Dereference operator
-    T& operator*() {
-        if (id == -1) {
-            throw std::runtime_error("Attempting to dereference a null MPointer");
+    // Proxy returned by operator*: reading it fetches the value, assigning to it
+    // sends the new value in a single SET
+    class Reference {
+    public:
+        operator T() const { return load(id); }
+        
+        Reference& operator=(const T& value) {
+            store(id, value);
+            return *this;
         }
         
-        if (!MemoryManagerClient::IsInitialized()) {
-            throw std::runtime_error("MemoryManagerClient not initialized");
+        Reference& operator=(const Reference& other) {
+            return *this = static_cast<T>(other);
         }
         
-        // Get the value from memory manager
-        if (!MemoryManagerClient::Get(id, &valueCache, sizeof(T))) {
-            throw std::runtime_error("Failed to get value from Memory Manager");
+        friend std::ostream& operator<<(std::ostream& out, const Reference& ref) {
+            return out << static_cast<T>(ref);
         }
         
-        return valueCache;
-    }
+    private:
+        friend class MPointer<T>;
+        explicit Reference(int id) : id(id) {}
+        int id;
+    };
     
-    // Arrow operator
-    T* operator->() {
-        if (id == -1) {
-            throw std::runtime_error("Attempting to use -> on a null MPointer");
+    // Local copy of the value returned by operator-> and write(). Changes made
+    // through it are sent back once, when the guard goes out of scope (or on
+    // flush()): only the bytes from the first to the last one that changed
+    class WriteGuard {
+    public:
+        WriteGuard(const WriteGuard&) = delete;
+        WriteGuard& operator=(const WriteGuard&) = delete;
+        
+        ~WriteGuard() {
+            try {
+                flush();
+            } catch (const std::exception& e) {
+                // Log but don't throw from destructor
+                std::cerr << "Error writing back MPointer " << id << ": " << e.what() << std::endl;
+            }
         }
         
-        if (!MemoryManagerClient::IsInitialized()) {
-            throw std::runtime_error("MemoryManagerClient not initialized");
+        T* operator->() { return &value; }
+        T& operator*() { return value; }
+        
+        // Send the changes made so far
+        void flush() {
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            size_t first = 0;
+            while (first < sizeof(T) && bytes[first] == original[first]) {
+                first++;
+            }
+            if (first == sizeof(T)) {
+                return;
+            }
+            size_t last = sizeof(T) - 1;
+            while (bytes[last] == original[last]) {
+                last--;
+            }
+            
+            if (!MemoryManagerClient::SetRange(id, first, bytes + first, last - first + 1)) {
+                throw std::runtime_error("Failed to set value in Memory Manager");
+            }
+            std::memcpy(original, &value, sizeof(T));
         }
         
-        if (!MemoryManagerClient::Get(id, &valueCache, sizeof(T))) {
-            throw std::runtime_error("Failed to get value from Memory Manager");
+    private:
+        friend class MPointer<T>;
+        explicit WriteGuard(int id) : id(id), value(load(id)) {
+            std::memcpy(original, &value, sizeof(T));
         }
         
-        // Store the value locally for the pointer to work
-        valuePtr = &valueCache;
-        return valuePtr;
+        int id;
+        T value;
+        char original[sizeof(T)];  // Bytes of the value as fetched (or last sent)
+    };
+    
+    // Dereference operator
+    Reference operator*() const {
+        check("dereference");
+        return Reference(id);
     }
     
-    // ID access method
-    int getId() const {
-        return id;
+    // Arrow operator (`ptr->field = x` fetches the value once and writes it back once)
+    WriteGuard operator->() const {
+        check("use -> on");
+        return WriteGuard(id);
     }
     
-    // Assignment operator for values
-    T& operator=(const T& value) {
-        if (id == -1) {
-            throw std::runtime_error("Attempting to assign to a null MPointer");
+    // Several changes with a single write back: auto value = ptr.write(); value->a = 1; value->b = 2;
+    WriteGuard write() const {
+        check("write through");
+        return WriteGuard(id);
+    }
+    
+    // One member of the value, read and written on its own: ptr.field(&Point::x) = 3
+    template <typename F>
+    class Field {
+    public:
+        operator F() const {
+            F value;
+            if (!MemoryManagerClient::GetRange(id, offset, &value, sizeof(F))) {
+                throw std::runtime_error("Failed to get field from Memory Manager");
+            }
+            return value;
         }
         
-        if (!MemoryManagerClient::IsInitialized()) {
-            throw std::runtime_error("MemoryManagerClient not initialized");
+        Field& operator=(const F& value) {
+            if (!MemoryManagerClient::SetRange(id, offset, &value, sizeof(F))) {
+                throw std::runtime_error("Failed to set field in Memory Manager");
+            }
+            return *this;
         }
         
-        if (!MemoryManagerClient::Set(id, &value, sizeof(T))) {
-            throw std::runtime_error("Failed to set value in Memory Manager");
+        Field& operator=(const Field& other) {
+            return *this = static_cast<F>(other);
         }
         
-        // Update local cache
-        valueCache = value;
+    private:
+        friend class MPointer<T>;
+        Field(int id, size_t offset) : id(id), offset(offset) {}
+        int id;
+        size_t offset;  // Offset of the member inside T
+    };
+    
+    template <typename F, typename C>
+    Field<F> field(F C::*member) const {
+        static_assert(std::is_base_of<C, T>::value, "field() needs a member of the pointed-to type");
+        check("access a field of");
         
-        return valueCache;
+        // Offset of the member, measured on uninitialized storage
+        alignas(T) char storage[sizeof(T)];
+        const T* object = reinterpret_cast<const T*>(storage);
+        size_t offset = reinterpret_cast<const char*>(&(object->*member)) - storage;
+        return Field<F>(id, offset);
     }
-
-    // Friend declaration to allow LinkedList implementation to access id directly
-    template <typename U>
-    friend class LinkedList;
     
+    // ID access method
+    int getId() const {
+        return id;
+    }
+    
+    // Assignment operator for values
+    MPointer<T>& operator=(const T& value) {
+        check("assign to");
+        store(id, value);
+        return *this;
+    }
+
     // Friend declaration for Node
     template <typename U>
     friend struct Node;
 
 private:
     int id;              // ID of the block in Memory Manager
-    T valueCache;        // Temporary storage for dereferenced value
-    T* valuePtr;         // Pointer to valueCache for -> operator
+    
+    void check(const char* operation) const {
+        if (id == -1) {
+            throw std::runtime_error(std::string("Attempting to ") + operation + " a null MPointer");
+        }
+        
+        if (!MemoryManagerClient::IsInitialized()) {
+            throw std::runtime_error("MemoryManagerClient not initialized");
+        }
+    }
+    
+    static T load(int id) {
+        T value;
+        if (!MemoryManagerClient::Get(id, &value, sizeof(T))) {
+            throw std::runtime_error("Failed to get value from Memory Manager");
+        }
+        return value;
+    }
+    
+    static void store(int id, const T& value) {
+        if (!MemoryManagerClient::Set(id, &value, sizeof(T))) {
+            throw std::runtime_error("Failed to set value in Memory Manager");
+        }
+    }
 };
 
 // Static members initialization
 int MemoryManagerClient::clientSocket = -1;
+std::mutex MemoryManagerClient::socketMutex;
 std::string MemoryManagerClient::host = "127.0.0.1";
 int MemoryManagerClient::port = 8080;
 std::atomic<bool> MemoryManagerClient::initialized(false);
+std::mutex MemoryManagerClient::refMutex;
+std::unordered_map<int, int> MemoryManagerClient::localRefs;
+std::unordered_set<int> MemoryManagerClient::pendingReleases;
+std::chrono::steady_clock::time_point MemoryManagerClient::lastRefFlush = std::chrono::steady_clock::now();
+std::mutex MemoryManagerClient::cacheMutex;
+std::unordered_map<int, MemoryManagerClient::CachedValue> MemoryManagerClient::cache;
+size_t MemoryManagerClient::cacheBytes = 0;
+std::atomic<MemoryManagerClient::CacheMode> MemoryManagerClient::cacheMode(MemoryManagerClient::CacheMode::STRICT);
+std::chrono::milliseconds MemoryManagerClient::cacheTtl(100);
+std::condition_variable MemoryManagerClient::refCondition;
+MemoryManagerClient::RefFlusher MemoryManagerClient::refFlusher;  // Last, so it stops before the rest is destroyed
 
 // MemoryManagerClient implementation
 void MemoryManagerClient::Init(int port, const std::string& host) {
@@ -218,15 +507,21 @@ void MemoryManagerClient::Init(int port, const std::string& host) {
     MemoryManagerClient::port = port;
     MemoryManagerClient::host = host;
     initialized = true;
+    refFlusher.start();
     
     std::cout << "MemoryManagerClient initialized with port " << port << " and host " << host << std::endl;
 }
 
 void MemoryManagerClient::Cleanup() {
-    if (clientSocket != -1) {
-        close(clientSocket);
-        clientSocket = -1;
+    refFlusher.stop();
+    if (initialized) {
+        FlushReferences();
+    }
+    {
+        std::lock_guard<std::mutex> lock(socketMutex);
+        disconnect();
     }
+    InvalidateCache();
     initialized = false;
     std::cout << "MemoryManagerClient cleaned up" << std::endl;
 }
@@ -236,18 +531,14 @@ int MemoryManagerClient::Create(size_t size, const std::string& type) {
         throw std::runtime_error("MemoryManagerClient not initialized");
     }
     
-    Message message;
+    Protocol::Header message;
     message.type = MessageType::CREATE;
     message.id = 0;  // Not used for CREATE
     message.size = size;
-    strncpy(message.typeStr, type.c_str(), sizeof(message.typeStr) - 1);
-    message.typeStr[sizeof(message.typeStr) - 1] = '\0';
+    message.payloadLength = static_cast<uint32_t>(type.size());
     
-    // Clear the data field
-    memset(message.data, 0, sizeof(message.data));
-    
-    Message response;
-    if (!sendMessage(message, response)) {
+    Protocol::Header response;
+    if (!sendRequest(message, type.data(), response)) {
         std::cerr << "Failed to create memory block of size " << size 
                   << " for type " << type << std::endl;
         return -1;
@@ -267,26 +558,31 @@ bool MemoryManagerClient::Set(int id, const void* value, size_t size) {
         return false;
     }
     
-    Message message;
+    if (size > UINT32_MAX) {
+        std::cerr << "Data size " << size << " exceeds the maximum message size" << std::endl;
+        return false;
+    }
+    
+    Protocol::Header message;
     message.type = MessageType::SET;
     message.id = id;
     message.size = size;
+    message.payloadLength = static_cast<uint32_t>(size);
     
-    if (size > sizeof(message.data)) {
-        std::cerr << "Warning: Data size " << size << " exceeds message buffer size " 
-                  << sizeof(message.data) << ". Data will be truncated." << std::endl;
-        size = sizeof(message.data);
-    }
-    
-    memcpy(message.data, value, size);
-    
-    Message response;
-    if (!sendMessage(message, response)) {
+    Protocol::Header response;
+    if (!sendRequest(message, value, response)) {
         std::cerr << "Failed to set value for ID: " << id << std::endl;
+        InvalidateCache(id);
         return false;
     }
     
-    return response.id != -1;
+    // The response carries the version of the value just written
+    if (cacheMode != CacheMode::OFF && size <= MAX_CACHED_VALUE) {
+        storeCached(id, response.size, value, size);
+    } else {
+        InvalidateCache(id);
+    }
+    return true;
 }
 
 bool MemoryManagerClient::Get(int id, void* value, size_t size) {
@@ -299,28 +595,319 @@ bool MemoryManagerClient::Get(int id, void* value, size_t size) {
         return false;
     }
     
-    Message message;
+    if (cacheMode != CacheMode::OFF && size <= MAX_CACHED_VALUE && getCached(id, value, size)) {
+        return true;
+    }
+    
+    Protocol::Header message;
     message.type = MessageType::GET;
     message.id = id;
     message.size = size;
-    memset(message.data, 0, sizeof(message.data));
     
-    Message response;
-    if (!sendMessage(message, response)) {
+    Protocol::Header response;
+    if (!sendRequest(message, nullptr, response, value, size)) {
+        std::cerr << "Failed to get value for ID: " << id << std::endl;
+        InvalidateCache(id);
+        return false;
+    }
+    
+    if (response.payloadLength != size) {
+        return false;
+    }
+    if (cacheMode != CacheMode::OFF && size <= MAX_CACHED_VALUE) {
+        storeCached(id, response.size, value, size);
+    }
+    return true;
+}
+
+bool MemoryManagerClient::SetRange(int id, size_t offset, const void* value, size_t size) {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    if (id == -1) {
+        std::cerr << "Cannot set range for invalid ID (-1)" << std::endl;
+        return false;
+    }
+    
+    if (size > UINT32_MAX - Protocol::RANGE_OFFSET_SIZE) {
+        std::cerr << "Data size " << size << " exceeds the maximum message size" << std::endl;
+        return false;
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::SET_RANGE;
+    message.id = id;
+    message.size = size;
+    message.payloadLength = static_cast<uint32_t>(Protocol::RANGE_OFFSET_SIZE + size);
+    std::vector<char> payload(message.payloadLength);
+    Protocol::putU64(reinterpret_cast<uint8_t*>(payload.data()), offset);
+    memcpy(payload.data() + Protocol::RANGE_OFFSET_SIZE, value, size);
+    
+    // The rest of a cached value may have been changed by someone else meanwhile
+    Protocol::Header response;
+    bool succeeded = sendRequest(message, payload.data(), response);
+    InvalidateCache(id);
+    if (!succeeded) {
+        std::cerr << "Failed to set range for ID: " << id << std::endl;
+    }
+    return succeeded;
+}
+
+bool MemoryManagerClient::GetRange(int id, size_t offset, void* value, size_t size) {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    if (id == -1) {
+        std::cerr << "Cannot get range for invalid ID (-1)" << std::endl;
+        return false;
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::GET_RANGE;
+    message.id = id;
+    message.size = size;
+    message.payloadLength = Protocol::RANGE_OFFSET_SIZE;
+    uint8_t offsetBytes[Protocol::RANGE_OFFSET_SIZE];
+    Protocol::putU64(offsetBytes, offset);
+    
+    Protocol::Header response;
+    if (!sendRequest(message, offsetBytes, response, value, size)) {
+        std::cerr << "Failed to get range for ID: " << id << std::endl;
+        return false;
+    }
+    
+    return response.payloadLength == size;
+}
+
+int MemoryManagerClient::ListCreate(size_t nodeSize, size_t nextOffset, size_t prevOffset, const std::string& nodeType) {
+    std::vector<char> payload(8 + nodeType.size());
+    Protocol::putU32(reinterpret_cast<uint8_t*>(payload.data()), static_cast<uint32_t>(nextOffset));
+    Protocol::putU32(reinterpret_cast<uint8_t*>(payload.data()) + 4, static_cast<uint32_t>(prevOffset));
+    memcpy(payload.data() + 8, nodeType.data(), nodeType.size());
+    
+    Protocol::ListState state;
+    return listRequest(MessageType::LIST_CREATE, 0, nodeSize, payload.data(), payload.size(), state);
+}
+
+int MemoryManagerClient::ListPushBack(int listId, const void* node, size_t size, Protocol::ListState& state) {
+    return listRequest(MessageType::LIST_PUSH_BACK, listId, size, node, size, state);
+}
+
+int MemoryManagerClient::ListPushFront(int listId, const void* node, size_t size, Protocol::ListState& state) {
+    return listRequest(MessageType::LIST_PUSH_FRONT, listId, size, node, size, state);
+}
+
+int MemoryManagerClient::ListPopFront(int listId, Protocol::ListState& state) {
+    int removed = listRequest(MessageType::LIST_POP_FRONT, listId, 0, nullptr, 0, state);
+    if (removed != -1) {
+        InvalidateCache(removed);
+    }
+    return removed;
+}
+
+int MemoryManagerClient::ListClear(int listId, Protocol::ListState& state) {
+    return listRequest(MessageType::LIST_CLEAR, listId, 0, nullptr, 0, state);
+}
+
+int MemoryManagerClient::ListAppend(int listId, const void* nodes, size_t nodeSize, size_t count,
+                                    std::vector<int>& ids, Protocol::ListState& state) {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    if (count == 0 || nodeSize == 0 || count > Protocol::MAX_PAYLOAD / nodeSize) {
+        std::cerr << "Cannot append " << count << " nodes of " << nodeSize << " bytes in one request" << std::endl;
+        return -1;
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::LIST_APPEND;
+    message.id = listId;
+    message.size = nodeSize;
+    message.payloadLength = static_cast<uint32_t>(count * nodeSize);
+    
+    // The response is the new state of the list and the ID of each node
+    Protocol::Header response;
+    std::vector<uint8_t> result(Protocol::LIST_STATE_SIZE + count * sizeof(int32_t));
+    if (!sendRequest(message, nodes, response, result.data(), result.size()) ||
+        static_cast<size_t>(response.id) != count || response.payloadLength != result.size()) {
+        std::cerr << "Failed to append to list " << listId << std::endl;
+        return -1;
+    }
+    
+    state = Protocol::decodeListState(result.data());
+    ids.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = static_cast<int32_t>(Protocol::getU32(result.data() + Protocol::LIST_STATE_SIZE + i * sizeof(int32_t)));
+    }
+    return response.id;
+}
+
+int MemoryManagerClient::ListTraverse(int listId, int startId, bool backward, size_t maxNodes, size_t nodeSize,
+                                      std::vector<int>& ids, std::vector<char>& nodes) {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    const size_t entrySize = sizeof(int32_t) + nodeSize;
+    maxNodes = std::min<size_t>(maxNodes, Protocol::MAX_PAYLOAD / entrySize);
+    
+    Protocol::Header message;
+    message.type = MessageType::LIST_TRAVERSE;
+    message.id = listId;
+    message.size = maxNodes;
+    message.payloadLength = Protocol::TRAVERSE_REQUEST_SIZE;
+    uint8_t request[Protocol::TRAVERSE_REQUEST_SIZE];
+    Protocol::putU32(request, static_cast<uint32_t>(startId));
+    Protocol::putU32(request + 4, backward ? Protocol::TRAVERSE_BACKWARD : Protocol::TRAVERSE_FORWARD);
+    
+    Protocol::Header response;
+    std::vector<char> entries(maxNodes * entrySize);
+    if (!sendRequest(message, request, response, entries.data(), entries.size()) ||
+        response.payloadLength != static_cast<size_t>(response.id) * entrySize ||
+        static_cast<size_t>(response.id) > maxNodes) {
+        std::cerr << "Failed to traverse list " << listId << std::endl;
+        return -1;
+    }
+    
+    // Split the entries into IDs and node contents
+    ids.resize(response.id);
+    nodes.resize(static_cast<size_t>(response.id) * nodeSize);
+    for (int i = 0; i < response.id; i++) {
+        const char* entry = entries.data() + i * entrySize;
+        ids[i] = static_cast<int32_t>(Protocol::getU32(reinterpret_cast<const uint8_t*>(entry)));
+        memcpy(nodes.data() + i * nodeSize, entry + sizeof(int32_t), nodeSize);
+    }
+    return response.id;
+}
+
+int MemoryManagerClient::listRequest(MessageType type, int id, size_t size, const void* payload, size_t payloadLength,
+                                     Protocol::ListState& state) {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    if (payloadLength > UINT32_MAX) {
+        std::cerr << "Data size " << payloadLength << " exceeds the maximum message size" << std::endl;
+        return -1;
+    }
+    
+    Protocol::Header message;
+    message.type = type;
+    message.id = id;
+    message.size = size;
+    message.payloadLength = static_cast<uint32_t>(payloadLength);
+    
+    Protocol::Header response;
+    uint8_t stateBytes[Protocol::LIST_STATE_SIZE];
+    if (!sendRequest(message, payload, response, stateBytes, sizeof(stateBytes)) ||
+        response.payloadLength != Protocol::LIST_STATE_SIZE) {
+        std::cerr << "List request " << static_cast<int>(type) << " failed for ID: " << id << std::endl;
+        return -1;
+    }
+    
+    state = Protocol::decodeListState(stateBytes);
+    return response.id;
+}
+
+bool MemoryManagerClient::getCached(int id, void* value, size_t size) {
+    // Returns false when the value has to be fetched with a plain GET
+    uint64_t knownVersion = 0;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(id);
+        if (it == cache.end() || it->second.data.size() != size) {
+            return false;
+        }
+        
+        // Served without asking the server
+        if (cacheMode == CacheMode::SESSION ||
+            (cacheMode == CacheMode::TTL && std::chrono::steady_clock::now() - it->second.validated < cacheTtl)) {
+            memcpy(value, it->second.data.data(), size);
+            return true;
+        }
+        knownVersion = it->second.version;
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::GET_IF_MODIFIED;
+    message.id = id;
+    message.size = size;
+    message.payloadLength = 8;
+    uint8_t versionBytes[8];
+    Protocol::putU64(versionBytes, knownVersion);
+    
+    Protocol::Header response;
+    if (!sendRequest(message, versionBytes, response, value, size)) {
         std::cerr << "Failed to get value for ID: " << id << std::endl;
+        InvalidateCache(id);
         return false;
     }
     
-    if (size > sizeof(response.data)) {
-        std::cerr << "Warning: Data size " << size << " exceeds message buffer size " 
-                  << sizeof(response.data) << ". Data will be truncated." << std::endl;
-        size = sizeof(response.data);
+    if (response.status == Protocol::Status::NOT_MODIFIED) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(id);
+        if (it == cache.end() || it->second.version != response.size || it->second.data.size() != size) {
+            return false;  // Dropped or replaced meanwhile
+        }
+        memcpy(value, it->second.data.data(), size);
+        it->second.validated = std::chrono::steady_clock::now();
+        return true;
     }
     
-    memcpy(value, response.data, size);
+    if (response.payloadLength != size) {
+        return false;
+    }
+    storeCached(id, response.size, value, size);
     return true;
 }
 
+void MemoryManagerClient::storeCached(int id, uint64_t version, const void* value, size_t size) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = cache.find(id);
+    if (it != cache.end()) {
+        // Versions only grow, an older response must not replace a newer value
+        if (it->second.version > version) {
+            return;
+        }
+        cacheBytes -= it->second.data.size();
+    } else if (cacheBytes + size > MAX_CACHE_BYTES) {
+        cache.clear();
+        cacheBytes = 0;
+    }
+    
+    CachedValue& entry = cache[id];
+    entry.version = version;
+    entry.data.assign(static_cast<const char*>(value), static_cast<const char*>(value) + size);
+    entry.validated = std::chrono::steady_clock::now();
+    cacheBytes += size;
+}
+
+void MemoryManagerClient::SetCacheMode(CacheMode mode, std::chrono::milliseconds ttl) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cacheMode = mode;
+    cacheTtl = ttl;
+    cache.clear();
+    cacheBytes = 0;
+}
+
+void MemoryManagerClient::InvalidateCache(int id) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (id == -1) {
+        cache.clear();
+        cacheBytes = 0;
+        return;
+    }
+    
+    auto it = cache.find(id);
+    if (it != cache.end()) {
+        cacheBytes -= it->second.data.size();
+        cache.erase(it);
+    }
+}
+
 bool MemoryManagerClient::IncreaseRefCount(int id) {
     if (!initialized) {
         throw std::runtime_error("MemoryManagerClient not initialized");
@@ -331,13 +918,12 @@ bool MemoryManagerClient::IncreaseRefCount(int id) {
         return false;
     }
     
-    Message message;
+    Protocol::Header message;
     message.type = MessageType::INCREASE_REF_COUNT;
     message.id = id;
-    message.size = 0;
     
-    Message response;
-    return sendMessage(message, response);
+    Protocol::Header response;
+    return sendRequest(message, nullptr, response);
 }
 
 bool MemoryManagerClient::DecreaseRefCount(int id) {
@@ -350,20 +936,157 @@ bool MemoryManagerClient::DecreaseRefCount(int id) {
         return false;
     }
     
-    Message message;
+    Protocol::Header message;
     message.type = MessageType::DECREASE_REF_COUNT;
     message.id = id;
-    message.size = 0;
     
-    Message response;
-    return sendMessage(message, response);
+    Protocol::Header response;
+    return sendRequest(message, nullptr, response);
+}
+
+bool MemoryManagerClient::RetainReference(int id) {
+    // Held while contacting the server, so the increment can't overtake a release
+    // of the same block that is being flushed
+    std::lock_guard<std::mutex> lock(refMutex);
+    if (localRefs[id]++ > 0 || pendingReleases.erase(id) > 0) {
+        return true;
+    }
+    
+    // First holder in this process: the server must know right away, a deferred
+    // increment could arrive after another client dropped the block
+    if (!IncreaseRefCount(id)) {
+        localRefs.erase(id);  // No server reference to share, don't pretend there is one
+        return false;
+    }
+    return true;
+}
+
+void MemoryManagerClient::AdoptReference(int id) {
+    std::lock_guard<std::mutex> lock(refMutex);
+    localRefs[id]++;
+}
+
+void MemoryManagerClient::ReleaseReference(int id) {
+    std::lock_guard<std::mutex> lock(refMutex);
+    auto it = localRefs.find(id);
+    if (it == localRefs.end() || --it->second > 0) {
+        return;
+    }
+    localRefs.erase(it);
+    pendingReleases.insert(id);
+    refCondition.notify_one();
+    
+    if (pendingReleases.size() >= REF_FLUSH_THRESHOLD ||
+        std::chrono::steady_clock::now() - lastRefFlush >= REF_FLUSH_INTERVAL) {
+        flushReferencesLocked();
+    }
+}
+
+bool MemoryManagerClient::FlushReferences() {
+    std::lock_guard<std::mutex> lock(refMutex);
+    return flushReferencesLocked();
+}
+
+bool MemoryManagerClient::flushReferencesLocked() {
+    lastRefFlush = std::chrono::steady_clock::now();
+    if (pendingReleases.empty()) {
+        return true;
+    }
+    
+    // All the releases go in one round trip
+    RequestBatch batch;
+    std::vector<int> released(pendingReleases.begin(), pendingReleases.end());
+    for (int id : released) {
+        batch.DecreaseRefCount(id);
+        InvalidateCache(id);  // The block may be freed and its slot reused
+    }
+    pendingReleases.clear();
+    bool succeeded = batch.Execute();
+    
+    // Retry the releases only if the server never got them. Once the batch was sent
+    // they may have been applied, and sending them again could free a block other
+    // processes still hold: leaking it is the safer outcome (a release answered with
+    // an error is for a block that is already gone)
+    if (!batch.Sent()) {
+        pendingReleases.insert(released.begin(), released.end());
+    }
+    return succeeded;
 }
 
-bool MemoryManagerClient::sendMessage(const Message& message, Message& response) {
-    // Create a temporary socket for each message
-    int tempSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (tempSocket < 0) {
+void MemoryManagerClient::flushPendingReferences() {
+    std::unique_lock<std::mutex> lock(refMutex);
+    while (true) {
+        refCondition.wait(lock, [] { return refFlusher.stopping || !pendingReleases.empty(); });
+        
+        // Let more releases join the batch until the interval is over
+        refCondition.wait_until(lock, lastRefFlush + REF_FLUSH_INTERVAL, [] { return refFlusher.stopping; });
+        if (refFlusher.stopping) {
+            return;
+        }
+        
+        if (!pendingReleases.empty() && std::chrono::steady_clock::now() - lastRefFlush >= REF_FLUSH_INTERVAL) {
+            try {
+                flushReferencesLocked();
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to flush references: " << e.what() << std::endl;
+            }
+        }
+    }
+}
+
+void MemoryManagerClient::RefFlusher::start() {
+    {
+        std::lock_guard<std::mutex> lock(refMutex);
+        if (thread.joinable()) {
+            return;
+        }
+        stopping = false;
+    }
+    thread = std::thread(&MemoryManagerClient::flushPendingReferences);
+}
+
+void MemoryManagerClient::RefFlusher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(refMutex);
+        stopping = true;
+    }
+    refCondition.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool MemoryManagerClient::RequestDump() {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::DUMP;
+    message.id = 0;
+    
+    Protocol::Header response;
+    return sendRequest(message, nullptr, response);
+}
+
+bool MemoryManagerClient::RequestSnapshot() {
+    if (!initialized) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::SNAPSHOT;
+    message.id = 0;
+    
+    Protocol::Header response;
+    return sendRequest(message, nullptr, response);
+}
+
+bool MemoryManagerClient::connectToServer() {
+    clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (clientSocket < 0) {
         std::cerr << "Failed to create socket" << std::endl;
+        clientSocket = -1;
         return false;
     }
     
@@ -375,116 +1098,316 @@ bool MemoryManagerClient::sendMessage(const Message& message, Message& response)
     
     if (inet_pton(AF_INET, host.c_str(), &serverAddr.sin_addr) <= 0) {
         std::cerr << "Invalid address: " << host << std::endl;
-        close(tempSocket);
+        disconnect();
         return false;
     }
     
-    if (connect(tempSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+    if (connect(clientSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
         std::cerr << "Connection failed to " << host << ":" << port << std::endl;
-        close(tempSocket);
+        disconnect();
         return false;
     }
     
-    // Create a wire-format message that matches the server's expectation
-    struct {
-        uint8_t type;
-        int id;
-        size_t size;
-        char typeStr[32];
-        char data[1024];
-    } wireMsg;
-    
-    // Copy fields from the original message
-    wireMsg.type = static_cast<uint8_t>(message.type);
-    wireMsg.id = message.id;
-    wireMsg.size = message.size;
-    strncpy(wireMsg.typeStr, message.typeStr, sizeof(wireMsg.typeStr) - 1);
-    wireMsg.typeStr[sizeof(wireMsg.typeStr) - 1] = '\0';
-    memcpy(wireMsg.data, message.data, sizeof(wireMsg.data));
-    
-    // Send message
-    if (send(tempSocket, &wireMsg, sizeof(wireMsg), 0) != sizeof(wireMsg)) {
-        std::cerr << "Failed to send message" << std::endl;
-        close(tempSocket);
-        return false;
+    // Each request is written in one go and waits for its answer, so disable Nagle
+    int opt = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    
+    return true;
+}
+
+bool MemoryManagerClient::connectionClosed(int socket) {
+    char byte;
+    ssize_t result = recv(socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+void MemoryManagerClient::disconnect() {
+    if (clientSocket != -1) {
+        close(clientSocket);
+        clientSocket = -1;
+    }
+}
+
+bool MemoryManagerClient::sendRequest(const Protocol::Header& request, const void* payload,
+                                      Protocol::Header& response, void* responseData,
+                                      size_t responseCapacity, bool* sent) {
+    std::lock_guard<std::mutex> lock(socketMutex);
+    if (sent) {
+        *sent = false;
     }
     
-    // Receive response into wire format first
-    if (recv(tempSocket, &wireMsg, sizeof(wireMsg), 0) != sizeof(wireMsg)) {
-        std::cerr << "Failed to receive response" << std::endl;
-        close(tempSocket);
-        return false;
+    // Reuse the open connection unless the server closed it while it was idle (e.g. it
+    // restarted): that is found out before sending anything
+    if (clientSocket != -1 && connectionClosed(clientSocket)) {
+        disconnect();
     }
     
-    // Copy back to the response format
-    response.type = static_cast<MessageType>(wireMsg.type);
-    response.id = wireMsg.id;
-    response.size = wireMsg.size;
-    strncpy(response.typeStr, wireMsg.typeStr, sizeof(response.typeStr) - 1);
-    response.typeStr[sizeof(response.typeStr) - 1] = '\0';
-    memcpy(response.data, wireMsg.data, sizeof(response.data));
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (clientSocket == -1 && !connectToServer()) {
+            return false;
+        }
+        
+        bool written = Protocol::sendFrame(clientSocket, request, payload);
+        if (written && sent) {
+            *sent = true;
+        }
+        if (written && Protocol::recvHeader(clientSocket, response)) {
+            break;
+        }
+        
+        // Once the whole frame is out the server may have run the request already
+        disconnect();
+        if (attempt == 1 || (written && !Protocol::isReadOnly(request.type))) {
+            std::cerr << "Failed to exchange message with Memory Manager" << std::endl;
+            return false;
+        }
+    }
     
-    // Close socket
-    close(tempSocket);
+    // Read the payload directly into the caller's buffer, dropping what doesn't fit
+    size_t received = std::min<size_t>(response.payloadLength, responseCapacity);
+    if (!Protocol::recvAll(clientSocket, responseData, received) ||
+        !Protocol::skipAll(clientSocket, response.payloadLength - received)) {
+        std::cerr << "Failed to receive response payload" << std::endl;
+        disconnect();
+        return false;
+    }
     
     // Debug output for specific message types
-    if (message.type == MessageType::CREATE) {
-        std::cout << "CREATE request: size=" << message.size 
-                  << ", type=" << message.typeStr 
+    if (request.type == MessageType::CREATE) {
+        std::cout << "CREATE request: size=" << request.size 
+                  << ", type=" << std::string(static_cast<const char*>(payload), request.payloadLength)
                   << " → response id=" << response.id << std::endl;
     }
     
-    return response.id != -1;
+    return response.status != Protocol::Status::ERROR && response.id != -1;
+}
+
+// RequestBatch implementation
+size_t RequestBatch::queue(Protocol::Header header, const void* data, void* output, size_t outputSize) {
+    size_t position = payload.size();
+    payload.resize(position + Protocol::HEADER_SIZE + header.payloadLength);
+    Protocol::encodeHeader(header, reinterpret_cast<uint8_t*>(payload.data() + position));
+    if (header.payloadLength > 0) {
+        memcpy(payload.data() + position + Protocol::HEADER_SIZE, data, header.payloadLength);
+    }
+    
+    entries.push_back({output, outputSize});
+    results.push_back(-1);
+    return entries.size() - 1;
+}
+
+size_t RequestBatch::Create(size_t size, const std::string& type) {
+    Protocol::Header header;
+    header.type = MessageType::CREATE;
+    header.id = 0;
+    header.size = size;
+    header.payloadLength = static_cast<uint32_t>(type.size());
+    return queue(header, type.data());
+}
+
+size_t RequestBatch::Set(int id, const void* value, size_t size) {
+    Protocol::Header header;
+    header.type = MessageType::SET;
+    header.id = id;
+    header.size = size;
+    header.payloadLength = static_cast<uint32_t>(size);
+    size_t index = queue(header, value);
+    entries[index].written = id;
+    return index;
+}
+
+size_t RequestBatch::SetCreated(size_t createIndex, const void* value, size_t size) {
+    Protocol::Header header;
+    header.type = MessageType::SET;
+    header.flags = Protocol::FLAG_ID_FROM_RESULT;
+    header.id = static_cast<int32_t>(createIndex);
+    header.size = size;
+    header.payloadLength = static_cast<uint32_t>(size);
+    return queue(header, value);
+}
+
+size_t RequestBatch::Get(int id, void* value, size_t size) {
+    Protocol::Header header;
+    header.type = MessageType::GET;
+    header.id = id;
+    header.size = size;
+    return queue(header, nullptr, value, size);
+}
+
+size_t RequestBatch::SetRange(int id, size_t offset, const void* value, size_t size) {
+    Protocol::Header header;
+    header.type = MessageType::SET_RANGE;
+    header.id = id;
+    header.size = size;
+    header.payloadLength = static_cast<uint32_t>(Protocol::RANGE_OFFSET_SIZE + size);
+    std::vector<char> data(header.payloadLength);
+    Protocol::putU64(reinterpret_cast<uint8_t*>(data.data()), offset);
+    memcpy(data.data() + Protocol::RANGE_OFFSET_SIZE, value, size);
+    size_t index = queue(header, data.data());
+    entries[index].written = id;
+    return index;
+}
+
+size_t RequestBatch::GetRange(int id, size_t offset, void* value, size_t size) {
+    Protocol::Header header;
+    header.type = MessageType::GET_RANGE;
+    header.id = id;
+    header.size = size;
+    header.payloadLength = Protocol::RANGE_OFFSET_SIZE;
+    uint8_t offsetBytes[Protocol::RANGE_OFFSET_SIZE];
+    Protocol::putU64(offsetBytes, offset);
+    return queue(header, offsetBytes, value, size);
+}
+
+size_t RequestBatch::IncreaseRefCount(int id) {
+    Protocol::Header header;
+    header.type = MessageType::INCREASE_REF_COUNT;
+    header.id = id;
+    return queue(header, nullptr);
+}
+
+size_t RequestBatch::DecreaseRefCount(int id) {
+    Protocol::Header header;
+    header.type = MessageType::DECREASE_REF_COUNT;
+    header.id = id;
+    return queue(header, nullptr);
+}
+
+void RequestBatch::Clear() {
+    payload.clear();
+    entries.clear();
+    results.clear();
+    sent = false;
+}
+
+bool RequestBatch::Execute() {
+    if (entries.empty()) {
+        return true;
+    }
+    sent = false;
+    
+    if (!MemoryManagerClient::IsInitialized()) {
+        throw std::runtime_error("MemoryManagerClient not initialized");
+    }
+    
+    if (payload.size() > Protocol::MAX_PAYLOAD) {
+        std::cerr << "Batch of " << entries.size() << " requests exceeds the maximum message size" << std::endl;
+        return false;
+    }
+    
+    Protocol::Header message;
+    message.type = MessageType::BATCH;
+    message.id = 0;
+    message.payloadLength = static_cast<uint32_t>(payload.size());
+    
+    // The response holds one frame per request, GET values included
+    size_t responseSize = 0;
+    for (const auto& entry : entries) {
+        responseSize += Protocol::HEADER_SIZE + entry.outputSize;
+    }
+    std::vector<char> responseData(responseSize);
+    
+    Protocol::Header response;
+    MemoryManagerClient::sendRequest(message, payload.data(), response, responseData.data(), responseData.size(), &sent);
+    
+    // Whatever the outcome, cached values of the blocks written may be stale now
+    for (const auto& entry : entries) {
+        if (entry.written != -1) {
+            MemoryManagerClient::InvalidateCache(entry.written);
+        }
+    }
+    
+    // Match every response back to its request
+    size_t position = 0;
+    size_t received = std::min<size_t>(response.payloadLength, responseData.size());
+    bool allSucceeded = true;
+    for (size_t i = 0; i < entries.size(); i++) {
+        Protocol::Header subResponse;
+        if (received - position < Protocol::HEADER_SIZE ||
+            !Protocol::decodeHeader(reinterpret_cast<const uint8_t*>(responseData.data() + position), subResponse) ||
+            subResponse.payloadLength > received - position - Protocol::HEADER_SIZE) {
+            // Requests after a failed exchange are left with result -1
+            return false;
+        }
+        position += Protocol::HEADER_SIZE;
+        
+        if (subResponse.status == Protocol::Status::OK) {
+            results[i] = subResponse.id;
+            if (entries[i].output) {
+                memcpy(entries[i].output, responseData.data() + position,
+                       std::min<size_t>(subResponse.payloadLength, entries[i].outputSize));
+            }
+        } else {
+            results[i] = -1;
+            allSucceeded = false;
+        }
+        position += subResponse.payloadLength;
+    }
+    
+    return allSucceeded;
 }
 
 // Specialization for std::string
 template<>
 class MPointer<std::string> {
 public:
-    // Default constructor - explicitly initialize all members
-    MPointer() : id(-1), valueCache(), valuePtr(nullptr) {}
+    // Default constructor
+    MPointer() : id(-1) {}
     
     // Destructor with safer implementation
     ~MPointer() {
         // Only decrease ref count if id is valid and client is initialized
         if (id != -1 && MemoryManagerClient::IsInitialized()) {
             try {
-                MemoryManagerClient::DecreaseRefCount(id);
+                MemoryManagerClient::ReleaseReference(id);
             } catch (const std::exception& e) {
                 // Log but don't throw from destructor
                 std::cerr << "Error in MPointer<std::string> destructor: " << e.what() << std::endl;
             }
         }
-        // Clear the valueCache to avoid potential issues with string data
-        valueCache.clear();
-        valuePtr = nullptr;
     }
     
-    // Copy constructor - explicitly initialize all members
-    MPointer(const MPointer<std::string>& other) : id(other.id), valueCache(), valuePtr(nullptr) {
+    // Copy constructor
+    MPointer(const MPointer<std::string>& other) : id(other.id) {
         if (id != -1 && MemoryManagerClient::IsInitialized()) {
-            MemoryManagerClient::IncreaseRefCount(id);
+            MemoryManagerClient::RetainReference(id);
         }
     }
     
-    // Assignment operator - properly handle all members
+    // Assignment operator
     MPointer<std::string>& operator=(const MPointer<std::string>& other) {
         if (this != &other) {
+            // Retain first, in case both point to the same block
+            if (other.id != -1 && MemoryManagerClient::IsInitialized()) {
+                MemoryManagerClient::RetainReference(other.id);
+            }
             if (id != -1 && MemoryManagerClient::IsInitialized()) {
-                MemoryManagerClient::DecreaseRefCount(id);
+                MemoryManagerClient::ReleaseReference(id);
             }
             
             id = other.id;
-            valueCache.clear();  // Clear existing string data
-            valuePtr = nullptr;
-            
-            if (id != -1 && MemoryManagerClient::IsInitialized()) {
-                MemoryManagerClient::IncreaseRefCount(id);
-            }
         }
         return *this;
     }
     
+    // Move constructor (the reference changes hands, nothing is sent)
+    MPointer(MPointer<std::string>&& other) noexcept : id(other.id) {
+        other.id = -1;
+    }
+    
+    // Move assignment (the reference held before is released like in the destructor)
+    MPointer<std::string>& operator=(MPointer<std::string>&& other) noexcept {
+        if (this != &other) {
+            MPointer<std::string> released(std::move(*this));
+            swap(other);
+        }
+        return *this;
+    }
+    
+    void swap(MPointer<std::string>& other) noexcept {
+        std::swap(id, other.id);
+    }
+    
     // New method with simplified approach for string
     static MPointer<std::string> New() {
         MPointer<std::string> ptr;
@@ -495,9 +1418,6 @@ public:
             throw std::runtime_error("Failed to allocate memory for string node");
         }
         
-        // Set the ID
-        ptr.id = id;
-        
         // Initialize with empty string
         Node<std::string> node;
         node.setData("");
@@ -510,50 +1430,89 @@ public:
             throw std::runtime_error("Failed to initialize memory for string node");
         }
         
+        // The reference returned by CREATE becomes the one this process holds
+        ptr.id = id;
+        MemoryManagerClient::AdoptReference(id);
+        
         return ptr;
     }
     
-    // Dereference operator for string
-    std::string& operator*() {
-        if (id == -1) {
-            throw std::runtime_error("Attempting to dereference a null MPointer<std::string>");
+    // Proxy returned by operator*: reading it fetches the string, assigning to it
+    // stores a new one
+    class Reference {
+    public:
+        operator std::string() const { return load(id); }
+        
+        Reference& operator=(const std::string& value) {
+            store(id, value);
+            return *this;
         }
         
-        if (!MemoryManagerClient::IsInitialized()) {
-            throw std::runtime_error("MemoryManagerClient not initialized");
+        Reference& operator=(const Reference& other) {
+            return *this = static_cast<std::string>(other);
         }
         
-        // Get the Node<std::string> from memory manager
-        Node<std::string> node;
-        if (!MemoryManagerClient::Get(id, &node, sizeof(Node<std::string>))) {
-            throw std::runtime_error("Failed to get string node from Memory Manager");
+        friend std::ostream& operator<<(std::ostream& out, const Reference& ref) {
+            return out << static_cast<std::string>(ref);
         }
         
-        // Update local cache
-        valueCache = node.getData();
-        return valueCache;
-    }
+    private:
+        friend class MPointer<std::string>;
+        explicit Reference(int id) : id(id) {}
+        int id;
+    };
     
-    // Arrow operator for string
-    std::string* operator->() {
-        if (id == -1) {
-            throw std::runtime_error("Attempting to use -> on a null MPointer<std::string>");
-        }
+    // Local copy of the string returned by operator-> and write(), stored back
+    // once when the guard goes out of scope (or on flush()) if it changed
+    class WriteGuard {
+    public:
+        WriteGuard(const WriteGuard&) = delete;
+        WriteGuard& operator=(const WriteGuard&) = delete;
         
-        if (!MemoryManagerClient::IsInitialized()) {
-            throw std::runtime_error("MemoryManagerClient not initialized");
+        ~WriteGuard() {
+            try {
+                flush();
+            } catch (const std::exception& e) {
+                // Log but don't throw from destructor
+                std::cerr << "Error writing back MPointer<std::string> " << id << ": " << e.what() << std::endl;
+            }
         }
         
-        // Get the Node<std::string> from memory manager
-        Node<std::string> node;
-        if (!MemoryManagerClient::Get(id, &node, sizeof(Node<std::string>))) {
-            throw std::runtime_error("Failed to get string node from Memory Manager");
+        std::string* operator->() { return &value; }
+        std::string& operator*() { return value; }
+        
+        // Send the changes made so far
+        void flush() {
+            if (value != original) {
+                store(id, value);
+                original = value;
+            }
         }
         
-        // Update local cache
-        valueCache = node.getData();
-        valuePtr = &valueCache;
-        return valuePtr;
+    private:
+        friend class MPointer<std::string>;
+        explicit WriteGuard(int id) : id(id), value(load(id)), original(value) {}
+        
+        int id;
+        std::string value;
+        std::string original;  // The string as fetched (or last sent)
+    };
+    
+    // Dereference operator for string
+    Reference operator*() const {
+        check("dereference");
+        return Reference(id);
+    }
+    
+    // Arrow operator for string (changes are written back once)
+    WriteGuard operator->() const {
+        check("use -> on");
+        return WriteGuard(id);
+    }
+    
+    WriteGuard write() const {
+        check("write through");
+        return WriteGuard(id);
     }
     
     // ID access method
@@ -562,45 +1521,52 @@ public:
     }
     
     // Assignment operator for string values
-    std::string& operator=(const std::string& value) {
+    MPointer<std::string>& operator=(const std::string& value) {
+        check("assign to");
+        store(id, value);
+        return *this;
+    }
+
+    // Friend declaration for Node
+    template <typename U>
+    friend struct Node;
+
+private:
+    int id;                 // ID of the block in Memory Manager
+    
+    void check(const char* operation) const {
         if (id == -1) {
-            throw std::runtime_error("Attempting to assign to a null MPointer<std::string>");
+            throw std::runtime_error(std::string("Attempting to ") + operation + " a null MPointer<std::string>");
         }
         
         if (!MemoryManagerClient::IsInitialized()) {
             throw std::runtime_error("MemoryManagerClient not initialized");
         }
-        
-        // Get the current node
+    }
+    
+    static std::string load(int id) {
+        // Get the Node<std::string> from memory manager
         Node<std::string> node;
         if (!MemoryManagerClient::Get(id, &node, sizeof(Node<std::string>))) {
-            throw std::runtime_error("Failed to get string node for assignment");
+            throw std::runtime_error("Failed to get string node from Memory Manager");
         }
-        
-        // Update the string data
+        return node.getData();
+    }
+    
+    static void store(int id, const std::string& value) {
+        // Only the string and its terminator are written, the links of the node stay as they are
+        Node<std::string> node;
         node.setData(value);
-        
-        // Save the updated node
-        if (!MemoryManagerClient::Set(id, &node, sizeof(Node<std::string>))) {
+        size_t length = std::min(value.size() + 1, sizeof(node.stringData));
+        if (!MemoryManagerClient::SetRange(id, offsetof(Node<std::string>, stringData), node.stringData, length)) {
             throw std::runtime_error("Failed to update string node");
         }
-        
-        // Update local cache
-        valueCache = value;
-        return valueCache;
     }
-
-    // Friend declarations
-    template <typename U>
-    friend class LinkedList;
-    
-    template <typename U>
-    friend struct Node;
-
-private:
-    int id;                 // ID of the block in Memory Manager
-    std::string valueCache; // Local cache for the string
-    std::string* valuePtr;  // Pointer to the local cache
 };
 
+template <typename T>
+void swap(MPointer<T>& a, MPointer<T>& b) noexcept {
+    a.swap(b);
+}
+
 #endif // MPOINTER_H
\ No newline at end of file
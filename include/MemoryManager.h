@@ -5,29 +5,106 @@
 #include <map>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <deque>
+#include <set>
 #include <fstream>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <iostream>
 #include <limits> // Para std::numeric_limits
+#include "Protocol.h"
+#include "PoolAllocator.h"
+#include "WriteAheadLog.h"
 
+class Snapshot;
+
+// A slot of the block table (32 bytes, the type name is interned). Blocks are limited
+// to MAX_SIZE bytes so the size fits in 32 bits
 class MemoryBlock {
 public:
-    MemoryBlock(size_t offset, size_t size, const std::string& type);
-    ~MemoryBlock() = default;
+    static constexpr size_t MAX_SIZE = UINT32_MAX;
+    static constexpr uint16_t MAX_PINS = UINT16_MAX;
+    
+    size_t offset = 0;             // Offset from the start of the memory pool
+    uint64_t version = 0;          // Changes whenever the contents do (validates client caches)
+    uint32_t size = 0;             // Size of the block in bytes
+    std::atomic<int> refCount{0};  // Reference counter (the block is freed once it drops to zero)
+    uint32_t typeId = 0;           // Index of the type name in the interned type table
+    uint16_t pinCount = 0;         // Transfers reading/writing the block in place (it can't move or be freed)
+    uint8_t generation = 0;        // Bumped every time the slot is reused, part of the block ID
+    bool used = false;             // The slot holds a block
+};
 
-    size_t offset;      // Offset from the start of the memory pool
-    size_t size;        // Size of the block in bytes
-    std::string type;   // Type of data stored
-    int refCount;       // Reference counter
-    bool inUse;         // Flag to mark if block is in use
+static_assert(sizeof(MemoryBlock) == 32, "Block table slots should stay 32 bytes");
+
+// One partition of the block table. Block IDs are slot numbers (see MemoryManager),
+// slot N lives in shard (N - 1) % shard count. Each shard has its own lock and keeps
+// the small blocks freed in it for reuse, so requests on different shards don't contend
+struct BlockShard {
+    static constexpr uint32_t SLOTS_PER_PAGE = 1024;
+    
+    std::shared_mutex mutex;                     // Shared for reads, exclusive for changes
+    std::vector<std::unique_ptr<MemoryBlock[]>> pages;  // Slots, in pages so they never move
+    uint32_t slotCount = 0;                      // Slots handed out so far
+    std::vector<uint32_t> freeSlots;             // Unused slots below slotCount
+    std::map<size_t, int> blocksByOffset;        // Offset -> ID of the blocks of this shard
+    std::vector<std::vector<size_t>> freeLists;  // Freed small blocks, index = size / ALIGNMENT - 1
+    size_t cachedBytes = 0;                      // Bytes parked in freeLists
+    
+    MemoryBlock& slot(uint32_t index) { return pages[index / SLOTS_PER_PAGE][index % SLOTS_PER_PAGE]; }
+};
+
+// Optional settings for MemoryManager (the defaults match the command line defaults)
+struct MemoryManagerOptions {
+    unsigned int workerThreads = 0;  // Threads serving requests, 0 = one per core
+    unsigned int blockShards = 16;   // Partitions of the block table, each with its own lock
+    bool verbose = false;            // Log every connection and request (std::cout serializes the workers)
+    
+    // Background compaction
+    unsigned int compactionIntervalMs = 100;  // Time between compaction steps, 0 = disabled
+    unsigned int compactionPauseUs = 2000;    // Time budget of one step (each move locks only while copying one block)
+    double compactionThreshold = 10.0;        // Fragmentation percentage that triggers a step
+    
+    // Memory dumps, written by a background thread (a DUMP request always writes one)
+    unsigned int dumpIntervalMs = 1000;  // Dump at most this often when something changed, 0 = disabled
+    size_t dumpEveryMutations = 0;       // Dump after this many changes, 0 = disabled
+    
+    // Binary snapshot of the blocks and the pool: loaded at startup if the file
+    // exists, written on shutdown and on SNAPSHOT requests. Empty = disabled
+    std::string snapshotFile;
+    
+    // File-backed pool: the pool is a shared mapping of DUMP_FOLDER/pool.bin and the
+    // block table is checkpointed next to it (pool.table), so a restart picks both up
+    // without copying the pool. The kernel pages the file, so the pool may exceed RAM
+    bool mappedPool = false;
+    bool populatePool = false;                 // Fault the whole file in at startup (MAP_POPULATE)
+    bool hugePages = false;                    // Ask for transparent huge pages (madvise)
+    unsigned int checkpointIntervalMs = 1000;  // msync + table checkpoint when something changed, 0 = only on shutdown
+    
+    // Write-ahead log of every change (DUMP_FOLDER/wal_*.log), replayed at startup on top
+    // of the last log checkpoint (DUMP_FOLDER/wal.checkpoint) to recover from a crash
+    bool writeAheadLog = false;
+    WriteAheadLog::SyncPolicy logSync = WriteAheadLog::SyncPolicy::BATCH;
+    unsigned int logCheckpointIntervalMs = 10000;  // Checkpoint and truncate the log this often, 0 = only on shutdown
+};
+
+// Result of the last compaction step
+struct CompactionStats {
+    double fragmentationPercent = 0.0;  // Before the step: 100 * (1 - largest free extent / free bytes)
+    size_t bytesMoved = 0;
+    size_t blocksMoved = 0;
 };
 
 class MemoryManager {
 public:
-    MemoryManager(int port, size_t sizeInMB, const std::string& dumpFolder);
+    MemoryManager(int port, size_t sizeInMB, const std::string& dumpFolder,
+                  const MemoryManagerOptions& options = MemoryManagerOptions());
     ~MemoryManager();
 
     // Server methods
@@ -36,40 +113,230 @@ public:
 
     // Memory management methods
     int create(size_t size, const std::string& type);
-    bool set(int id, const void* value, size_t valueSize);
-    bool get(int id, void* value, size_t valueSize);
+    bool set(int id, const void* value, size_t valueSize, uint64_t* version = nullptr);
+    
+    // Read or write `length` bytes at `offset` inside the block (the range must fit in it)
+    bool setRange(int id, size_t offset, const void* value, size_t length, uint64_t* version = nullptr);
+    bool getRange(int id, size_t offset, void* value, size_t length);
+    
+    // Lists kept by the server (see Protocol.h). Each operation holds the lock of
+    // its list, so concurrent insertions and removals never interleave. They
+    // return the ID of the handle, the new node or the removed node (-1 on failure)
+    int listCreate(size_t nodeSize, size_t nextOffset, size_t prevOffset, const std::string& nodeType,
+                   Protocol::ListState& state);
+    int listPush(int listId, bool front, const void* node, size_t nodeSize, Protocol::ListState& state);
+    int listPopFront(int listId, Protocol::ListState& state);
+    
+    // Add the nodes in `nodes` (a whole number of nodes) at the back, their IDs go
+    // to `ids`. Returns the number of nodes added, -1 on failure (nothing is added)
+    int listAppend(int listId, const void* nodes, size_t length, std::vector<int32_t>& ids,
+                   Protocol::ListState& state);
+    
+    // Release every node, returns how many (-1 on failure)
+    int listClear(int listId, Protocol::ListState& state);
+    
+    // Append up to `maxNodes` nodes starting at `startId` to `out` (i32 ID and node
+    // each, see LIST_TRAVERSE). Returns the number of nodes read, -1 on failure
+    int listTraverse(int listId, int startId, bool backward, size_t maxNodes, std::vector<char>& out);
+    
+    // With `version`, also returns the version of the block; the value is only
+    // copied if it differs from `knownVersion`
+    bool get(int id, void* value, size_t valueSize, uint64_t* version = nullptr, uint64_t knownVersion = 0);
     bool increaseRefCount(int id);
     bool decreaseRefCount(int id);
+    
+    // Pin a block to read or write `size` bytes of it in place without holding the
+    // lock (used to stream large values). Returns nullptr if the block is unknown or
+    // smaller than `size`; every successful pin must be matched by unpinBlock
+    char* pinBlock(int id, size_t size);
+    void unpinBlock(int id, bool written);
+    
+    CompactionStats getCompactionStats();
+    
+    // Ask the dump thread to write a memory dump (returns right away)
+    void requestDump();
+    
+    // Binary snapshot of the block table and the pool contents
+    bool saveSnapshot(const std::string& path);
+    bool loadSnapshot(const std::string& path);
 
 private:
     // Memory pool
     void* memoryPool;
     size_t poolSize;
+    int poolFd;                       // Backing file of a mapped pool, -1 when malloc'd
     
     // Dump folder
     std::string dumpFolder;
     
-    // Mapping of IDs to memory blocks
-    std::map<int, MemoryBlock> blocks;
-    int nextId;
+    // Memory dumps
+    std::atomic<size_t> pendingMutations;  // Changes since the last dump
+    bool dumpRequested;
+    std::mutex dumpMutex;
+    std::condition_variable dumpCondition;
+    
+    // Checkpoints of a mapped pool
+    std::atomic<uint64_t> changeCount;  // Changes to the pool or the block table, never reset
+    uint64_t checkpointedChanges;       // changeCount covered by the last checkpoint
+    std::mutex checkpointMutex;
+    std::condition_variable checkpointCondition;
+    std::mutex checkpointWriteMutex;    // One checkpoint at a time, taken before relocationMutex
+    
+    // Write-ahead log, nullptr when disabled
+    std::unique_ptr<WriteAheadLog> wal;
+    
+    // Block IDs: the low SLOT_BITS bits are the slot of the block (from 1), the bits
+    // above count how often the slot was reused, so the stale ID of a freed block
+    // doesn't reach the block that took its slot (until the generation wraps)
+    static constexpr int SLOT_BITS = 24;
+    static constexpr uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+    static constexpr uint8_t GENERATION_MASK = 0x7f;
+    
+    // Mapping of IDs to memory blocks. Locks are taken in this order: a list lock,
+    // shards (by index), allocatorMutex, then the log
+    std::vector<BlockShard> shards;
+    std::atomic<unsigned int> nextShard;  // Shard of the next block created (round robin)
+    
+    // Source of block versions. Starts at the current time in nanoseconds, so a
+    // restarted server never hands out a version a client may have cached
+    std::atomic<uint64_t> versionClock;
+    
+    // Interned type names, a block only keeps the index
+    std::vector<std::string> typeNames;
+    std::map<std::string, uint32_t> typeIds;
+    std::shared_mutex typesMutex;
+    
+    // Server-side lists: the handle block starts with a ListHeader followed by the
+    // type name of the nodes. Each list has a lock, picked by the slot of the handle
+    struct ListHeader;
+    static constexpr size_t LIST_LOCKS = 64;
+    std::mutex listLocks[LIST_LOCKS];
     
-    // Thread safety
-    std::mutex blocksMutex;
+    // Free space of the memory pool, shared by the shards
+    PoolAllocator allocator;
+    std::mutex allocatorMutex;
+    std::atomic<size_t> shardCachedBytes;  // Bytes parked in the free lists of the shards
+    
+    // Extents of a mapped pool freed or vacated since the last checkpoint (offset, size),
+    // guarded by allocatorMutex. The table on disk may still point at them, so they only
+    // go back to the allocator once the next checkpoint is durable
+    std::vector<std::pair<size_t, size_t>> quarantinedExtents;
     
     // Server
     int port;
-    bool running;
+    MemoryManagerOptions options;
+    std::atomic<bool> running;
+    int serverSocket;
+    int epollFd;
+    int wakeupFd;                     // eventfd used to wake the reactor on shutdown
     std::thread serverThread;
     std::thread gcThread;
+    std::thread compactorThread;
+    std::thread dumpThread;
+    std::thread checkpointThread;
+    std::thread logCheckpointThread;
+    std::vector<std::thread> workerThreads;
+    
+    // Connections with a pending request, handed from the reactor to the workers
+    std::deque<int> readyConnections;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    
+    // Open client connections (to shut them down when stopping)
+    std::set<int> connections;
+    std::mutex connectionsMutex;
     
     // Private methods
+    bool setupListener();
     void serverLoop();
+    void workerLoop();
+    void acceptConnections();
+    void closeConnection(int clientSocket);
+    bool handleRequest(int clientSocket);  // Serves one request, false when the connection must be closed
+    bool adjustRefCount(int id, int delta);
+    void processRequest(const Protocol::Header& request, const char* payload,
+                        Protocol::Header& response, std::vector<char>& responseData);
+    void processBatch(const Protocol::Header& request, const char* payload,
+                      Protocol::Header& response, std::vector<char>& responseData);
+    bool streamSet(int clientSocket, const Protocol::Header& request);
+    bool streamGet(int clientSocket, const Protocol::Header& request);
     void garbageCollector();
+    void scheduleReclaim(int id);
     void createMemoryDump();
+    Snapshot takeSnapshot(bool withContents, std::vector<char>& contents, uint64_t* logSegment = nullptr);
+    void dumper();
+    void recordMutation();
+    bool restoreBlocks(const Snapshot& snapshot);
+    std::mutex& listLock(int listId);
+    bool readListHeader(int listId, ListHeader& header, std::string* nodeType = nullptr);
+    bool hasType(int id, uint32_t typeId);
+    // Point the link at `offset` of a node to `target`, its old value goes to `previous`
+    bool relink(int nodeId, size_t offset, int32_t target, int32_t& previous);
+    
+    // One line on std::cout for a connection or a request, only with options.verbose
+    template <typename... Parts>
+    void trace(const Parts&... parts) const {
+        if (options.verbose) {
+            std::ostringstream line;
+            (line << ... << parts) << '\n';
+            std::cout << line.str() << std::flush;
+        }
+    }
+    
+    // Block table
+    BlockShard& shardFor(int id) { return shards[((id & SLOT_MASK) - 1) % shards.size()]; }
+    MemoryBlock* findBlock(BlockShard& shard, int id);
+    int blockId(size_t shardIndex, uint32_t slot, uint8_t generation) const;
+    int newSlot(size_t shardIndex);
+    MemoryBlock* placeBlock(int id);
+    void freeSlot(BlockShard& shard, int id);
+    void rebuildFreeSlots();
+    uint32_t internType(const std::string& type);
+    std::string typeName(uint32_t typeId);
+    std::vector<std::unique_lock<std::shared_mutex>> lockAllShards();
+    size_t allocateBlock(BlockShard& shard, size_t size);
+    void releaseBlock(BlockShard& shard, size_t offset, size_t size);
+    int insertBlock(size_t shardIndex, size_t offset, size_t size, const std::string& type);
+    void drainShardCaches();
+    void freeExtent(size_t offset, size_t size);  // allocatorMutex held
+    size_t countBlocks();
+    
+    // Mapped pool
+    bool mapPool();
+    void unmapPool();
+    bool checkpoint();
+    void checkpointer();
+    std::string poolFilePath() const { return dumpFolder + "/pool.bin"; }
+    std::string tableFilePath() const { return dumpFolder + "/pool.table"; }
+    
+    // Write-ahead log
+    bool recoverFromLog();
+    bool replayRecord(const WriteAheadLog::Record& record);
+    bool checkpointLog();
+    void logCheckpointer();
+    void commitLog();
+    std::string logCheckpointPath() const { return dumpFolder + "/wal.checkpoint"; }
+    
+    // Blocks whose reference count dropped to zero, waiting for the garbage collector
+    std::vector<int> reclaimQueue;
+    std::mutex reclaimMutex;
+    std::condition_variable reclaimCondition;
+    
+    // Background compaction
+    std::mutex compactorMutex;
+    std::condition_variable compactorCondition;
+    CompactionStats lastCompaction;
+    
+    // Held while blocks are moved inside the pool (compaction, defragmentation) and by
+    // checkpoint() from the table capture to the msync, so the saved table always
+    // matches the pool on disk. Taken before the shard locks
+    std::mutex relocationMutex;
     
     // Memory allocation helpers
-    size_t findFreeSpace(size_t size);
     void defragmentMemory();
+    void compactor();
+    CompactionStats compactionStep();
+    double fragmentationPercent() const;
 };
 
 #endif // MEMORY_MANAGER_H
\ No newline at end of file
@@ -53,4 +53,23 @@ struct Node<std::string> {
     }
 };
 
+// Helpers to read and write the element of a node the same way for every T
+template <typename T>
+void setNodeData(Node<T>& node, const T& value) {
+    node.data = value;
+}
+
+inline void setNodeData(Node<std::string>& node, const std::string& value) {
+    node.setData(value);
+}
+
+template <typename T>
+T getNodeData(const Node<T>& node) {
+    return node.data;
+}
+
+inline std::string getNodeData(const Node<std::string>& node) {
+    return node.getData();
+}
+
 #endif // NODE_H
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <vector>
+#include <utility>
+#include <limits>
+
+// Allocator for the MemoryManager pool. It only hands out offsets, the pool
+// itself is owned by MemoryManager.
+//
+// Small blocks (up to SMALL_LIMIT bytes) are recycled through one free list per
+// size class, so allocating and freeing them is O(1). Everything else comes from
+// an ordered tree of free extents (best fit, O(log n)) that is coalesced with its
+// neighbours on free. Small blocks parked in the free lists go back to the tree
+// when an allocation can't be satisfied otherwise.
+class PoolAllocator {
+public:
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t SMALL_LIMIT = 1024;
+    static constexpr size_t NO_SPACE = std::numeric_limits<size_t>::max();
+
+    explicit PoolAllocator(size_t poolSize);
+
+    // Returns the offset of a free range of at least `size` bytes, or NO_SPACE
+    size_t allocate(size_t size);
+
+    // Returns the lowest free range of at least `size` bytes that ends before
+    // `limit`, or NO_SPACE (used to move blocks towards the start of the pool)
+    size_t allocateBelow(size_t size, size_t limit);
+
+    // Gives back a range returned by allocate (same size as requested)
+    void release(size_t offset, size_t size);
+
+    // Return the small blocks parked in the free lists to the tree, so that
+    // adjacent free ranges are merged
+    void coalesce();
+
+    // Forget the current state and treat everything outside `usedExtents`
+    // (offset, size pairs) as free, e.g. after the pool was compacted
+    void rebuild(const std::vector<std::pair<size_t, size_t>>& usedExtents);
+
+    // Space really taken by a block of `size` bytes
+    static size_t roundUp(size_t size);
+
+    size_t getFreeBytes() const { return freeBytes; }
+    size_t getLargestFreeExtent() const;
+
+    // Free extents of the tree (offset -> size), small blocks in the free lists excluded
+    const std::map<size_t, size_t>& getFreeExtents() const { return extentsByOffset; }
+
+private:
+    size_t poolSize;
+    size_t freeBytes;     // Free bytes, free lists included
+    size_t cachedBytes;   // Bytes parked in the size-class free lists
+
+    std::vector<std::vector<size_t>> sizeClasses;     // Free offsets, index = size / ALIGNMENT - 1
+    std::map<size_t, size_t> extentsByOffset;         // Free extents: offset -> size
+    std::set<std::pair<size_t, size_t>> extentsBySize; // Free extents: (size, offset)
+
+    size_t allocateExtent(size_t size);
+    void insertExtent(size_t offset, size_t size);
+    void eraseExtent(std::map<size_t, size_t>::iterator it);
+};
+
+#endif // POOL_ALLOCATOR_H
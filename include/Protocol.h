@@ -0,0 +1,278 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Message types for communication with Memory Manager
+enum class MessageType : uint8_t {
+    CREATE = 1,
+    SET = 2,
+    GET = 3,
+    INCREASE_REF_COUNT = 4,
+    DECREASE_REF_COUNT = 5,
+    BATCH = 6,
+    DUMP = 7,
+    SNAPSHOT = 8,
+    GET_IF_MODIFIED = 9,
+    GET_RANGE = 10,
+    SET_RANGE = 11,
+    LIST_CREATE = 12,
+    LIST_PUSH_BACK = 13,
+    LIST_PUSH_FRONT = 14,
+    LIST_POP_FRONT = 15,
+    LIST_TRAVERSE = 16,
+    LIST_APPEND = 17,
+    LIST_CLEAR = 18
+};
+
+// Wire protocol shared by MemoryManager and MemoryManagerClient.
+//
+// Every message is a fixed 20 byte header followed by exactly `payloadLength`
+// bytes of payload. All header fields are big-endian (network order):
+//
+//   offset  size  field
+//   0       1     version        (Protocol::VERSION)
+//   1       1     type           (MessageType)
+//   2       1     status         (Status, only meaningful in responses)
+//   3       1     flags          (FLAG_* bits)
+//   4       4     id             (signed block ID, -1 = none/failure)
+//   8       8     size           (CREATE: block size, GET: bytes requested)
+//   16      4     payloadLength
+//
+// Payloads: CREATE carries the type name, SET the value, a GET response the value.
+// Every block has a version that changes whenever its contents do (versions are
+// never 0 and never reused, not even across restarts); GET and SET responses
+// carry it in `size`. GET_IF_MODIFIED is a GET whose payload is the u64 version
+// the client already has (big-endian): if it is still current the response has
+// status NOT_MODIFIED and no payload.
+// GET_RANGE and SET_RANGE read/write part of a block: their payload starts with
+// the u64 offset inside the block (big-endian), `size` is the length of the range
+// and a SET_RANGE payload continues with the bytes to write. A range that doesn't
+// fit in the block is an error.
+// Lists: the Memory Manager can keep doubly linked lists of blocks and do the
+// linking itself, so an insertion or removal is a single request. LIST_CREATE
+// takes the node size in `size` and, as payload, the offsets of the next and
+// previous links (int32 block IDs) inside a node as two u32 followed by the type
+// name of the nodes; it returns the ID of the list handle (a block of type "List").
+// LIST_PUSH_BACK/LIST_PUSH_FRONT take the handle and a whole node as payload (its
+// links are filled in by the server) and return the ID of the new node, which
+// belongs to the list. LIST_POP_FRONT unlinks and releases the first node and
+// returns its ID. The responses of the list requests carry the ListState of the
+// list after the operation.
+// LIST_TRAVERSE reads up to `size` consecutive nodes of a list in one response.
+// Its payload is the i32 ID of the first node (-1 = the head, or the tail going
+// backward) and a u32 direction (TRAVERSE_FORWARD follows the next links,
+// TRAVERSE_BACKWARD the previous ones). The response id is the number of nodes
+// read and the payload has, for each one, its i32 ID followed by the whole node.
+// It stops early at the end of the list or when the payload would grow too large.
+// LIST_APPEND is a LIST_PUSH_BACK of several nodes at once: the payload is the
+// nodes one after the other, the response id is the number of nodes added and its
+// payload the ListState followed by the i32 ID of each new node, in list order.
+// LIST_CLEAR releases every node of a list; the response id is the number of
+// nodes released and the payload the (empty) ListState.
+// A BATCH payload is a sequence of complete request frames; they are served in
+// order and the BATCH response carries one complete response frame for each
+// (its id is the number of requests served, its status ERROR if any failed).
+// Values are sent whole whatever their size: the server streams values larger
+// than STREAM_THRESHOLD straight between the socket and the block in the pool.
+namespace Protocol {
+
+constexpr uint8_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 20;
+
+// Largest payload the server buffers in memory (streamed values are only bounded by the block size)
+constexpr uint32_t MAX_PAYLOAD = 64 * 1024 * 1024;
+
+// Values above this size are streamed in place instead of being copied under the lock.
+// A streamed SET is not atomic with respect to concurrent readers of the same block
+constexpr uint32_t STREAM_THRESHOLD = 64 * 1024;
+
+// Inside a batch: `id` is the index of an earlier request in the same batch and
+// the request applies to the ID that request returned (e.g. SET after CREATE)
+constexpr uint8_t FLAG_ID_FROM_RESULT = 0x01;
+
+// Payload prefix of GET_RANGE and SET_RANGE
+constexpr size_t RANGE_OFFSET_SIZE = 8;
+
+enum class Status : uint8_t {
+    OK = 0,
+    ERROR = 1,
+    NOT_MODIFIED = 2  // GET_IF_MODIFIED: the client's copy is current
+};
+
+// Payload of LIST_TRAVERSE: i32 first node, u32 direction
+constexpr size_t TRAVERSE_REQUEST_SIZE = 8;
+constexpr uint32_t TRAVERSE_FORWARD = 0;
+constexpr uint32_t TRAVERSE_BACKWARD = 1;
+
+// Head, tail and length of a list (LIST_STATE_SIZE bytes: three big-endian u32)
+struct ListState {
+    int32_t head = -1;
+    int32_t tail = -1;
+    uint32_t count = 0;
+};
+
+constexpr size_t LIST_STATE_SIZE = 12;
+
+// Requests that don't change anything on the server, so sending one again after
+// its response was lost is harmless
+inline bool isReadOnly(MessageType type) {
+    return type == MessageType::GET || type == MessageType::GET_IF_MODIFIED ||
+           type == MessageType::GET_RANGE || type == MessageType::LIST_TRAVERSE;
+}
+
+struct Header {
+    uint8_t version = VERSION;
+    MessageType type = MessageType::CREATE;
+    Status status = Status::OK;
+    uint8_t flags = 0;
+    int32_t id = -1;
+    uint64_t size = 0;
+    uint32_t payloadLength = 0;
+};
+
+inline void putU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+inline uint32_t getU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | static_cast<uint32_t>(in[3]);
+}
+
+inline void putU64(uint8_t* out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value >> 32));
+    putU32(out + 4, static_cast<uint32_t>(value));
+}
+
+inline uint64_t getU64(const uint8_t* in) {
+    return (static_cast<uint64_t>(getU32(in)) << 32) | getU32(in + 4);
+}
+
+inline void encodeHeader(const Header& header, uint8_t* out) {
+    out[0] = header.version;
+    out[1] = static_cast<uint8_t>(header.type);
+    out[2] = static_cast<uint8_t>(header.status);
+    out[3] = header.flags;
+    putU32(out + 4, static_cast<uint32_t>(header.id));
+    putU64(out + 8, header.size);
+    putU32(out + 16, header.payloadLength);
+}
+
+inline void encodeListState(const ListState& state, uint8_t* out) {
+    putU32(out, static_cast<uint32_t>(state.head));
+    putU32(out + 4, static_cast<uint32_t>(state.tail));
+    putU32(out + 8, state.count);
+}
+
+inline ListState decodeListState(const uint8_t* in) {
+    ListState state;
+    state.head = static_cast<int32_t>(getU32(in));
+    state.tail = static_cast<int32_t>(getU32(in + 4));
+    state.count = getU32(in + 8);
+    return state;
+}
+
+// Returns false if the header was written by an incompatible protocol version
+inline bool decodeHeader(const uint8_t* in, Header& header) {
+    header.version = in[0];
+    header.type = static_cast<MessageType>(in[1]);
+    header.status = static_cast<Status>(in[2]);
+    header.flags = in[3];
+    header.id = static_cast<int32_t>(getU32(in + 4));
+    header.size = getU64(in + 8);
+    header.payloadLength = getU32(in + 16);
+    return header.version == VERSION;
+}
+
+// Read exactly `length` bytes, returns false if the peer closed or an error happened
+inline bool recvAll(int socket, void* buffer, size_t length) {
+    char* ptr = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t n = recv(socket, ptr, length, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Discard `length` bytes (payload we have no room for)
+inline bool skipAll(int socket, size_t length) {
+    char scratch[4096];
+    while (length > 0) {
+        size_t chunk = length < sizeof(scratch) ? length : sizeof(scratch);
+        if (!recvAll(socket, scratch, chunk)) {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+// Write all the buffers in one go (MSG_NOSIGNAL so a closed peer doesn't kill the process)
+inline bool sendAllv(int socket, struct iovec* iov, int count) {
+    while (count > 0) {
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+
+        // Skip what was already written
+        size_t written = static_cast<size_t>(n);
+        while (count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Send a header followed by its payload (header.payloadLength bytes)
+inline bool sendFrame(int socket, const Header& header, const void* payload) {
+    uint8_t encoded[HEADER_SIZE];
+    encodeHeader(header, encoded);
+
+    struct iovec iov[2];
+    iov[0].iov_base = encoded;
+    iov[0].iov_len = HEADER_SIZE;
+    iov[1].iov_base = const_cast<void*>(payload);
+    iov[1].iov_len = header.payloadLength;
+    return sendAllv(socket, iov, header.payloadLength > 0 ? 2 : 1);
+}
+
+// Receive a header, returns false on a closed connection or a version mismatch
+inline bool recvHeader(int socket, Header& header) {
+    uint8_t encoded[HEADER_SIZE];
+    if (!recvAll(socket, encoded, HEADER_SIZE)) {
+        return false;
+    }
+    return decodeHeader(encoded, header);
+}
+
+} // namespace Protocol
+
+#endif // PROTOCOL_H
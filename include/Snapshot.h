@@ -0,0 +1,50 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+// A block of the block table, as stored in a snapshot
+struct SnapshotBlock {
+    int id;
+    size_t offset;
+    size_t size;
+    int refCount;
+    std::string type;
+};
+
+// Binary snapshot of a MemoryManager: the block table plus the contents of the pool.
+//
+// File layout (all integers little-endian):
+//   header      magic "MPSNAP01", u32 version, u32 flags, u64 pool size,
+//               u64 pool bytes stored, i32 next ID, u32 block count,
+//               u64 timestamp (ms since epoch)
+//   block table per block: i32 id, u64 offset, u64 size, i32 refCount,
+//               u16 type length, type name
+//   pool        `poolBytes` bytes, from offset 0 of the pool
+//
+// The table and the pool are written with a few large sequential writes.
+class Snapshot {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    size_t poolSize = 0;        // Size of the pool the snapshot was taken from
+    size_t poolBytes = 0;       // Bytes of pool contents stored (up to the end of the last block)
+    int nextId = 1;
+    uint64_t timestamp = 0;     // Milliseconds since epoch
+    std::vector<SnapshotBlock> blocks;
+
+    // Write the snapshot, `pool` must hold at least poolBytes bytes (nullptr = table only)
+    bool save(const std::string& path, const char* pool) const;
+
+    // Read a snapshot. The pool contents are copied into `pool` when it is not
+    // nullptr, which fails if they don't fit in `poolCapacity` bytes
+    bool load(const std::string& path, char* pool, size_t poolCapacity);
+
+    // Write the table in the human-readable memory dump layout
+    void writeText(std::ostream& out) const;
+};
+
+#endif // SNAPSHOT_H
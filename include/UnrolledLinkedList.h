@@ -0,0 +1,268 @@
+#ifndef UNROLLED_LINKED_LIST_H
+#define UNROLLED_LINKED_LIST_H
+
+#include "LinkedList.h"
+#include <iostream>
+#include <deque>
+#include <iterator>
+#include <cstdint>
+#include <type_traits>
+
+// Block of an unrolled list: up to N elements stored together. The elements live in
+// items[first, first + count), so pushes at either end and popFront never move them
+template <typename T, size_t N>
+struct Chunk {
+    uint32_t first;
+    uint32_t count;
+    T items[N];
+};
+
+template <typename T, size_t N>
+std::ostream& operator<<(std::ostream& out, const Chunk<T, N>& chunk) {
+    out << "[";
+    for (uint32_t i = 0; i < chunk.count; i++) {
+        out << (i > 0 ? ", " : "") << chunk.items[chunk.first + i];
+    }
+    return out << "]";
+}
+
+// Default chunk size: about 256 bytes of elements per block
+template <typename T>
+constexpr size_t defaultChunkSize() {
+    return sizeof(T) < 256 ? 256 / sizeof(T) : 1;
+}
+
+// Linked list that stores N elements per Memory Manager block instead of one, so a
+// list needs N times fewer blocks and links, indexed access reads one chunk and a
+// scan gets N elements per node read. Elements are copied byte by byte, so T must be
+// trivially copyable (use LinkedList for strings).
+//
+// The chunks are the nodes of a LinkedList; the number of elements of each one is
+// mirrored here to find the chunk of an index without asking the server. Filling or
+// emptying an existing chunk is a read-modify-write of that chunk, so the list must
+// only be modified by its owner
+template <typename T, size_t N = defaultChunkSize<T>()>
+class UnrolledLinkedList {
+    static_assert(std::is_trivially_copyable<T>::value, "UnrolledLinkedList elements must be trivially copyable");
+    static_assert(N > 0, "Chunks must hold at least one element");
+
+public:
+    using ChunkType = Chunk<T, N>;
+    
+    // Read-only forward iterator over the elements, reads whole windows of chunks
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+        
+        const_iterator() : position(0) {}
+        
+        reference operator*() const { return chunk->items[position]; }
+        pointer operator->() const { return &chunk->items[position]; }
+        
+        const_iterator& operator++() {
+            if (++position == chunk->first + chunk->count) {
+                ++chunk;
+                skipEmpty();
+            }
+            return *this;
+        }
+        
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        
+        bool operator==(const const_iterator& other) const {
+            return chunk == other.chunk && position == other.position;
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    
+    private:
+        friend class UnrolledLinkedList;
+        
+        typename LinkedList<ChunkType>::const_iterator chunk;
+        uint32_t position;  // Index in the items of the current chunk, 0 at the end
+        
+        explicit const_iterator(typename LinkedList<ChunkType>::const_iterator start)
+            : chunk(start), position(0) {
+            skipEmpty();
+        }
+        
+        void skipEmpty() {
+            while (chunk.nodeId() != -1 && chunk->count == 0) {
+                ++chunk;
+            }
+            position = chunk.nodeId() != -1 ? chunk->first : 0;
+        }
+    };
+    
+    using iterator = const_iterator;
+    
+    UnrolledLinkedList() : size(0) {}
+    
+    UnrolledLinkedList(const UnrolledLinkedList&) = delete;
+    UnrolledLinkedList& operator=(const UnrolledLinkedList&) = delete;
+    
+    // Add element to the back of the list
+    void pushBack(const T& value) {
+        // A new chunk starts at the beginning of its items, later pushBacks fill the rest
+        if (counts.empty() || counts.back().first + counts.back().count == N) {
+            ChunkType chunk = {0, 1, {}};
+            chunk.items[0] = value;
+            chunks.pushBack(chunk);
+            counts.push_back({0, 1});
+        } else {
+            update(static_cast<int>(counts.size()) - 1, [&](ChunkType& chunk) {
+                chunk.items[chunk.first + chunk.count] = value;
+                chunk.count++;
+            });
+        }
+        size++;
+    }
+    
+    // Add element to the front of the list
+    void pushFront(const T& value) {
+        // A new chunk starts at the end of its items, later pushFronts fill it backwards
+        if (counts.empty() || counts.front().first == 0) {
+            ChunkType chunk = {static_cast<uint32_t>(N - 1), 1, {}};
+            chunk.items[N - 1] = value;
+            chunks.pushFront(chunk);
+            counts.push_front({static_cast<uint32_t>(N - 1), 1});
+        } else {
+            update(0, [&](ChunkType& chunk) {
+                chunk.first--;
+                chunk.items[chunk.first] = value;
+                chunk.count++;
+            });
+        }
+        size++;
+    }
+    
+    // Remove the first element, the last one of a chunk releases the chunk
+    bool popFront() {
+        if (counts.empty()) {
+            return false;
+        }
+        
+        if (counts.front().count == 1) {
+            if (!chunks.popFront()) {
+                return false;
+            }
+            counts.pop_front();
+        } else {
+            update(0, [](ChunkType& chunk) {
+                chunk.first++;
+                chunk.count--;
+            });
+        }
+        size--;
+        return true;
+    }
+    
+    // Get value at index (reads the chunk that holds it)
+    bool get(int index, T& value) {
+        uint32_t item;
+        int chunkIndex = locate(index, item);
+        ChunkType chunk;
+        if (chunkIndex == -1 || !chunks.get(chunkIndex, chunk)) {
+            return false;
+        }
+        
+        value = chunk.items[item];
+        return true;
+    }
+    
+    // Set value at index
+    bool set(int index, const T& value) {
+        uint32_t item;
+        int chunkIndex = locate(index, item);
+        if (chunkIndex == -1) {
+            return false;
+        }
+        
+        ChunkType chunk;
+        if (!chunks.get(chunkIndex, chunk)) {
+            return false;
+        }
+        chunk.items[item] = value;
+        return chunks.set(chunkIndex, chunk);
+    }
+    
+    // Clear the list
+    void clear() {
+        chunks.clear();
+        counts.clear();
+        size = 0;
+    }
+    
+    const_iterator begin() const {
+        return const_iterator(chunks.begin());
+    }
+    
+    const_iterator end() const {
+        return const_iterator(chunks.end());
+    }
+    
+    // Print the list
+    void print() {
+        if (size == 0) {
+            std::cout << "List [empty]" << std::endl;
+            return;
+        }
+        
+        std::cout << "List [" << size << "] in " << counts.size() << " chunks" << std::endl;
+        
+        int nodeCount = 0;
+        for (const T& value : *this) {
+            std::cout << "  " << nodeCount++ << ": " << value << std::endl;
+        }
+    }
+
+private:
+    struct ChunkCount {
+        uint32_t first;
+        uint32_t count;
+    };
+    
+    LinkedList<ChunkType> chunks;
+    std::deque<ChunkCount> counts;  // Mirror of the first/count of every chunk, in list order
+    int size;                       // Number of elements in the list
+    
+    // Chunk holding `index` and the position of the element in its items, -1 if out of range
+    int locate(int index, uint32_t& item) const {
+        if (index < 0 || index >= size) {
+            return -1;
+        }
+        
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (static_cast<uint32_t>(index) < counts[i].count) {
+                item = counts[i].first + index;
+                return static_cast<int>(i);
+            }
+            index -= counts[i].count;
+        }
+        return -1;
+    }
+    
+    // Read a chunk, change it and write it back
+    template <typename F>
+    void update(int chunkIndex, F change) {
+        ChunkType chunk;
+        if (!chunks.get(chunkIndex, chunk)) {
+            throw std::runtime_error("Failed to read list chunk");
+        }
+        
+        change(chunk);
+        if (!chunks.set(chunkIndex, chunk)) {
+            throw std::runtime_error("Failed to write list chunk");
+        }
+        counts[chunkIndex] = {chunk.first, chunk.count};
+    }
+};
+
+#endif // UNROLLED_LINKED_LIST_H
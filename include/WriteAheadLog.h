@@ -0,0 +1,125 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+// Append-only log of the changes made to a MemoryManager, replayed at startup on
+// top of the last checkpoint to recover the blocks after a crash.
+//
+// Records are appended to an in-memory buffer (callers never touch the disk) and
+// written by a flusher thread. Every write takes whatever was appended while the
+// previous one was in progress, so many records share a single fsync (group commit).
+//
+// The log is split into segments (wal_NNNNNN.log). A checkpoint starts a new segment
+// at the exact point of a snapshot and, once the snapshot is on disk, discards the
+// older segments.
+//
+// Record layout (all integers little-endian):
+//   u32 body length, u32 checksum (FNV-1a of the body), body:
+//   u8 type, i32 id, then
+//     CREATE     u64 size, u16 type length, type name
+//     SET        u64 length, value
+//     SET_RANGE  u64 offset, u64 length, value (written at `offset` inside the block)
+//     REF_COUNT  i32 reference count (absolute, so replaying a record twice is harmless)
+//     FREE       nothing
+class WriteAheadLog {
+public:
+    enum class SyncPolicy {
+        NONE,    // Never fsync, the OS writes the log whenever it wants
+        BATCH,   // fsync every group written by the flusher, requests don't wait for it
+        PER_OP   // Requests are answered once their records are on disk
+    };
+
+    enum class RecordType : uint8_t {
+        CREATE = 1,
+        SET = 2,
+        REF_COUNT = 3,
+        FREE = 4,
+        SET_RANGE = 5
+    };
+
+    // A record read back by replay (data points into the segment being replayed)
+    struct Record {
+        RecordType type;
+        int id = -1;
+        size_t size = 0;           // CREATE: block size; SET, SET_RANGE: value length
+        size_t offset = 0;         // SET_RANGE
+        int refCount = 0;          // REF_COUNT
+        std::string blockType;     // CREATE
+        const char* data = nullptr; // SET, SET_RANGE
+    };
+
+    WriteAheadLog(const std::string& folder, SyncPolicy policy);
+    ~WriteAheadLog();
+
+    // Discard every segment and start an empty log (after recovery)
+    bool open();
+
+    // Write out everything appended and stop the flusher
+    void close();
+
+    // Append a record, returns its log sequence number
+    uint64_t logCreate(int id, size_t size, const std::string& type);
+    uint64_t logSet(int id, const char* value, size_t length);
+    uint64_t logSetRange(int id, size_t offset, const char* value, size_t length);
+    uint64_t logRefCount(int id, int refCount);
+    uint64_t logFree(int id);
+
+    // With PER_OP, wait until the record `lsn` (and everything before it) is on disk
+    void commit(uint64_t lsn);
+
+    // Records appended since the last rotate
+    bool hasNewRecords();
+
+    // Write out the current segment and start a new one. The caller must make sure
+    // nothing is appended meanwhile. Returns the number of the closed segment, 0 on error
+    uint64_t rotate();
+
+    // Delete the segments up to `segment` (their changes are in a checkpoint)
+    void discardUpTo(uint64_t segment);
+
+    // Replay every segment in `folder`, oldest first. Stops at the first torn or
+    // corrupt record (the tail of a write interrupted by a crash). Returns false
+    // if `apply` does
+    static bool replay(const std::string& folder, const std::function<bool(const Record&)>& apply);
+
+    static const char* policyName(SyncPolicy policy);
+    static bool parsePolicy(const std::string& name, SyncPolicy& policy);
+
+private:
+    std::string folder;
+    SyncPolicy policy;
+    int fd;
+    uint64_t segment;        // Number of the segment being written
+
+    // Appended records not written yet
+    std::mutex mutex;
+    std::condition_variable flushCondition;    // Wakes the flusher
+    std::condition_variable durableCondition;  // Wakes commit()
+    std::vector<char> buffer;
+    uint64_t appendedLsn;
+    uint64_t writtenLsn;     // Last record written (and synced, unless the policy is NONE)
+    uint64_t rotatedLsn;     // appendedLsn at the last rotate
+    bool stopping;
+    bool failed;
+
+    // Held while a group is written, so rotate() never splits one between segments
+    std::mutex ioMutex;
+    std::thread flusherThread;
+
+    size_t beginRecord(RecordType type, int id);
+    uint64_t endRecord(size_t start);
+    void flusher();
+    bool writeOut(const std::vector<char>& data, uint64_t lsn);
+    bool openSegment();
+    static std::string segmentPath(const std::string& folder, uint64_t segment);
+    static std::vector<uint64_t> listSegments(const std::string& folder);
+};
+
+#endif // WRITE_AHEAD_LOG_H
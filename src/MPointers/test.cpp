@@ -1,6 +1,13 @@
 #include "../../include/MPointer.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <thread>
+
+struct Point {
+    int x;
+    int y;
+};
 
 // Simple test for MPointer
 int main() {
@@ -38,6 +45,83 @@ int main() {
         anotherPtr = myPtr;
         std::cout << "Value after assignment: " << *anotherPtr << std::endl;
         
+        // Copies only touch the local reference tally, releases go out in one batch
+        std::cout << "Copying MPointers..." << std::endl;
+        {
+            ReferenceScope scope;
+            std::vector<MPointer<int>> copies(1000, myPtr);
+            for (int i = 0; i < 100; i++) {
+                copies.push_back(MPointer<int>::New());
+            }
+        }
+        std::cout << "Value after dropping the copies: " << *myPtr << std::endl;
+        
+        // A failed retain must not leave a local reference behind
+        int freedId = MemoryManagerClient::Create(sizeof(int), "int");
+        MemoryManagerClient::DecreaseRefCount(freedId);
+        if (MemoryManagerClient::RetainReference(freedId) || MemoryManagerClient::RetainReference(freedId)) {
+            throw std::runtime_error("Retained a reference to a freed block");
+        }
+        
+        // A release left pending is sent after REF_FLUSH_INTERVAL even if nothing else happens
+        int droppedId;
+        MemoryManagerClient::FlushReferences();
+        {
+            MPointer<int> dropped = MPointer<int>::New();
+            droppedId = dropped.getId();
+        }
+        std::this_thread::sleep_for(MemoryManagerClient::REF_FLUSH_INTERVAL * 3);
+        if (MemoryManagerClient::IncreaseRefCount(droppedId)) {
+            throw std::runtime_error("Pending release was not flushed");
+        }
+        
+        // Moves and swaps hand the reference over without contacting the server
+        std::cout << "Moving and swapping MPointers..." << std::endl;
+        MPointer<int> moved = std::move(anotherPtr);
+        swap(moved, anotherPtr);
+        if (moved.getId() != -1 || anotherPtr.getId() != myPtr.getId()) {
+            throw std::runtime_error("Move or swap did not transfer the ID");
+        }
+        std::cout << "Value after moving back: " << *anotherPtr << std::endl;
+        
+        // Cached reads: a write that bypasses the cache is seen once the cache is checked again
+        std::cout << "Reading through the cache..." << std::endl;
+        MemoryManagerClient::SetCacheMode(MemoryManagerClient::CacheMode::SESSION);
+        int first = *myPtr;
+        int outside = first + 1;
+        RequestBatch write;
+        write.Set(myPtr.getId(), &outside, sizeof(outside));
+        if (!write.Execute() || *myPtr != outside) {
+            throw std::runtime_error("Cached value not refreshed after a write");
+        }
+        MemoryManagerClient::SetCacheMode(MemoryManagerClient::CacheMode::STRICT);
+        if (*myPtr != outside || *myPtr != outside) {
+            throw std::runtime_error("Revalidated value differs from the stored one");
+        }
+        *myPtr = first;
+        std::cout << "Cached value: " << *myPtr << std::endl;
+        
+        // Field updates through -> are written back once, when the expression (or the guard) ends
+        std::cout << "Updating fields..." << std::endl;
+        MPointer<Point> point = MPointer<Point>::New();
+        point->x = 3;
+        {
+            auto value = point.write();
+            value->x += 1;
+            value->y = 7;
+        }
+        if (point->x != 4 || point->y != 7) {
+            throw std::runtime_error("Field updates were not written back");
+        }
+        
+        // A single member travels on its own
+        point.field(&Point::y) = 9;
+        int y = point.field(&Point::y);
+        if (y != 9 || point->x != 4) {
+            throw std::runtime_error("Field access read or wrote the wrong bytes");
+        }
+        std::cout << "Point: " << point->x << ", " << point->y << std::endl;
+        
         // Test with different type
         std::cout << "Creating MPointer<std::string>..." << std::endl;
         MPointer<std::string> strPtr = MPointer<std::string>::New();
@@ -50,6 +134,30 @@ int main() {
         // Get the string value
         std::cout << "String value: " << *strPtr << std::endl;
         
+        // Test a block much larger than a single network buffer
+        std::cout << "Creating a 2MB block..." << std::endl;
+        std::vector<int> largeValue(512 * 1024);
+        for (size_t i = 0; i < largeValue.size(); i++) {
+            largeValue[i] = static_cast<int>(i * 7);
+        }
+        size_t largeSize = largeValue.size() * sizeof(int);
+        int largeId = MemoryManagerClient::Create(largeSize, "int[]");
+        if (largeId == -1 || !MemoryManagerClient::Set(largeId, largeValue.data(), largeSize)) {
+            throw std::runtime_error("Failed to store large block");
+        }
+        
+        std::vector<int> largeCopy(largeValue.size());
+        if (!MemoryManagerClient::Get(largeId, largeCopy.data(), largeSize) || largeCopy != largeValue) {
+            throw std::runtime_error("Large block read back with different contents");
+        }
+        std::cout << "Large block read back correctly (" << largeSize << " bytes)" << std::endl;
+        MemoryManagerClient::DecreaseRefCount(largeId);
+        
+        // Ask for a memory dump of the current state
+        if (!MemoryManagerClient::RequestDump()) {
+            throw std::runtime_error("Failed to request a memory dump");
+        }
+        
         // Clean up
         MemoryManagerClient::Cleanup();
         std::cout << "Test completed successfully" << std::endl;
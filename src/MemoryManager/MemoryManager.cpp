@@ -1,348 +1,2021 @@
 #include "../../include/MemoryManager.h"
+#include "../../include/Snapshot.h"
 #include <iostream>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <filesystem>
 #include <algorithm> // Añadido para std::sort
+#include <cerrno>
 
-// MemoryBlock implementation
-MemoryBlock::MemoryBlock(size_t offset, size_t size, const std::string& type)
-    : offset(offset), size(size), type(type), refCount(1), inUse(true) {
+namespace {
+
+// Sequence number of the last log record appended by this thread, made durable
+// by commitLog() before the request is answered
+thread_local uint64_t loggedLsn = 0;
+
+// Bytes of freed small blocks a shard keeps for itself, the rest goes back to the allocator
+const size_t SHARD_CACHE_BYTES = 256 * 1024;
+
+// Type of the blocks that hold a server-side list
+const char* const LIST_TYPE = "List";
+
+// Both links of a list node must fit in it without overlapping
+bool validNodeLayout(size_t nodeSize, size_t nextOffset, size_t prevOffset) {
+    const size_t link = sizeof(int32_t);
+    return nodeSize <= UINT32_MAX && nextOffset <= UINT32_MAX && prevOffset <= UINT32_MAX &&
+           nextOffset + link <= nodeSize && prevOffset + link <= nodeSize &&
+           (nextOffset >= prevOffset + link || prevOffset >= nextOffset + link);
 }
 
+} // namespace
+
 // MemoryManager implementation
-MemoryManager::MemoryManager(int port, size_t sizeInMB, const std::string& dumpFolder)
-    : memoryPool(nullptr), poolSize(sizeInMB * 1024 * 1024), dumpFolder(dumpFolder),
-      nextId(1), port(port), running(false) {
+MemoryManager::MemoryManager(int port, size_t sizeInMB, const std::string& dumpFolder,
+                             const MemoryManagerOptions& options)
+    : memoryPool(nullptr), poolSize(sizeInMB * 1024 * 1024), poolFd(-1), dumpFolder(dumpFolder),
+      pendingMutations(0), dumpRequested(false), changeCount(0), checkpointedChanges(0), shards(std::max(1u, options.blockShards)), nextShard(0),
+      versionClock(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()),
+      allocator(poolSize), shardCachedBytes(0), port(port), options(options), running(false),
+      serverSocket(-1), epollFd(-1), wakeupFd(-1) {
+    
+    for (auto& shard : shards) {
+        shard.freeLists.resize(PoolAllocator::SMALL_LIMIT / PoolAllocator::ALIGNMENT);
+    }
     
     // Create the dump folder if it doesn't exist
     if (!std::filesystem::exists(dumpFolder)) {
         std::filesystem::create_directories(dumpFolder);
     }
     
-    // Allocate memory pool (this is the ONLY malloc in the project)
-    memoryPool = malloc(poolSize);
-    if (!memoryPool) {
-        std::cerr << "Failed to allocate memory pool of size " << sizeInMB << "MB" << std::endl;
-        exit(1);
+    if (options.mappedPool) {
+        // Map the pool file and pick up the blocks of the last checkpoint
+        if (!mapPool()) {
+            exit(1);
+        }
+        
+        std::cout << "Memory pool of " << sizeInMB << "MB mapped from " << poolFilePath() << std::endl;
+        
+        if (std::filesystem::exists(tableFilePath())) {
+            Snapshot table;
+            if (!table.load(tableFilePath(), nullptr, 0) || !restoreBlocks(table)) {
+                std::cerr << "Failed to load block table " << tableFilePath()
+                          << " (remove it to start with an empty pool)" << std::endl;
+                exit(1);
+            }
+            std::cout << "Recovered " << table.blocks.size() << " blocks from " << tableFilePath() << std::endl;
+        }
+    } else {
+        // Allocate memory pool (this is the ONLY malloc in the project)
+        memoryPool = malloc(poolSize);
+        if (!memoryPool) {
+            std::cerr << "Failed to allocate memory pool of size " << sizeInMB << "MB" << std::endl;
+            exit(1);
+        }
+        
+        std::cout << "Memory pool of " << sizeInMB << "MB allocated at " << memoryPool << std::endl;
+    }
+    
+    // Recover the blocks of a previous run
+    if (!options.snapshotFile.empty() && std::filesystem::exists(options.snapshotFile)) {
+        if (!loadSnapshot(options.snapshotFile)) {
+            std::cerr << "Failed to load snapshot " << options.snapshotFile << std::endl;
+            exit(1);
+        }
+    }
+    
+    // Replay the changes logged since the last checkpoint, then start an empty log
+    if (options.writeAheadLog) {
+        wal = std::make_unique<WriteAheadLog>(dumpFolder, options.logSync);
+        if (!recoverFromLog() || !wal->open()) {
+            std::cerr << "Failed to recover from the write-ahead log in " << dumpFolder << std::endl;
+            exit(1);
+        }
+        std::cout << "Write-ahead log enabled (sync: " << WriteAheadLog::policyName(options.logSync) << ")" << std::endl;
+    }
+}
+
+MemoryManager::~MemoryManager() {
+    stopServer();
+    
+    // Write out the last log records
+    if (wal) {
+        wal->close();
+    }
+    
+    // Free the memory pool
+    if (poolFd != -1) {
+        unmapPool();
+    } else if (memoryPool) {
+        free(memoryPool);
+        memoryPool = nullptr;
+    }
+}
+
+bool MemoryManager::startServer() {
+    if (!setupListener()) {
+        return false;
+    }
+    
+    running = true;
+    
+    // Start reactor thread
+    serverThread = std::thread(&MemoryManager::serverLoop, this);
+    
+    // Start the workers that serve the requests
+    unsigned int workers = options.workerThreads;
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned int i = 0; i < workers; i++) {
+        workerThreads.emplace_back(&MemoryManager::workerLoop, this);
+    }
+    std::cout << "Serving requests with " << workers << " worker threads" << std::endl;
+    
+    // Start garbage collector thread
+    gcThread = std::thread(&MemoryManager::garbageCollector, this);
+    
+    // Start the thread that writes the memory dumps
+    dumpThread = std::thread(&MemoryManager::dumper, this);
+    
+    // Start background compaction
+    if (options.compactionIntervalMs > 0) {
+        compactorThread = std::thread(&MemoryManager::compactor, this);
+    }
+    
+    // Start the checkpoints of a mapped pool
+    if (poolFd != -1 && options.checkpointIntervalMs > 0) {
+        checkpointThread = std::thread(&MemoryManager::checkpointer, this);
+    }
+    
+    // Start the checkpoints that keep the write-ahead log short
+    if (wal && options.logCheckpointIntervalMs > 0) {
+        logCheckpointThread = std::thread(&MemoryManager::logCheckpointer, this);
+    }
+    
+    return true;
+}
+
+void MemoryManager::stopServer() {
+    bool wasRunning = running.exchange(false);
+    
+    if (wasRunning) {
+        // Wake up the reactor and the idle workers
+        uint64_t one = 1;
+        if (write(wakeupFd, &one, sizeof(one)) < 0) {
+            std::cerr << "Error waking up server thread" << std::endl;
+        }
+        queueCondition.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(compactorMutex);
+            compactorCondition.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(reclaimMutex);
+            reclaimCondition.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(dumpMutex);
+            dumpCondition.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(checkpointMutex);
+            checkpointCondition.notify_all();
+        }
+        
+        // Unblock workers that are in the middle of a request
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (int clientSocket : connections) {
+            shutdown(clientSocket, SHUT_RDWR);
+        }
+    }
+    
+    // Wait for threads to finish
+    if (serverThread.joinable()) {
+        serverThread.join();
+    }
+    
+    for (auto& worker : workerThreads) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workerThreads.clear();
+    
+    if (gcThread.joinable()) {
+        gcThread.join();
+    }
+    
+    if (compactorThread.joinable()) {
+        compactorThread.join();
+    }
+    
+    if (dumpThread.joinable()) {
+        dumpThread.join();
+    }
+    
+    if (checkpointThread.joinable()) {
+        checkpointThread.join();
+    }
+    
+    if (logCheckpointThread.joinable()) {
+        logCheckpointThread.join();
+    }
+    
+    // Keep the blocks for the next run
+    if (wasRunning && !options.snapshotFile.empty()) {
+        saveSnapshot(options.snapshotFile);
+    }
+    if (wasRunning && poolFd != -1) {
+        checkpoint();
+    }
+    if (wasRunning && wal) {
+        checkpointLog();
+    }
+    
+    // Release the sockets
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (int clientSocket : connections) {
+            close(clientSocket);
+        }
+        connections.clear();
+    }
+    readyConnections.clear();
+    
+    for (int* fd : {&serverSocket, &epollFd, &wakeupFd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+int MemoryManager::create(size_t size, const std::string& type) {
+    if (size > MemoryBlock::MAX_SIZE) {
+        std::cerr << "Block size " << size << " exceeds the maximum of " << MemoryBlock::MAX_SIZE << " bytes" << std::endl;
+        return -1;
+    }
+    
+    size_t shardIndex = nextShard++ % shards.size();
+    BlockShard& shard = shards[shardIndex];
+    
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        size_t offset = allocateBlock(shard, size);
+        if (offset != PoolAllocator::NO_SPACE) {
+            int id = insertBlock(shardIndex, offset, size, type);
+            if (id == -1) {
+                releaseBlock(shard, offset, size);
+            }
+            return id;
+        }
+    }
+    
+    // Out of space. A mapped pool gets back the extents freed since the last checkpoint
+    // by taking one now
+    if (poolFd != -1) {
+        checkpoint();
+    }
+    
+    // Give the small blocks parked in the shards back and try again
+    std::lock_guard<std::mutex> relocationLock(relocationMutex);
+    auto locks = lockAllShards();
+    std::lock_guard<std::mutex> allocatorLock(allocatorMutex);
+    drainShardCaches();
+    size_t offset = allocator.allocate(size);
+    if (offset == PoolAllocator::NO_SPACE) {
+        // Try to defragment and find space again. Not in a mapped pool: the blocks would
+        // overwrite extents the table on disk still points at
+        if (poolFd == -1) {
+            defragmentMemory();
+            offset = allocator.allocate(size);
+        }
+        
+        if (offset == PoolAllocator::NO_SPACE) {
+            std::cerr << "Failed to allocate " << size << " bytes for type " << type << std::endl;
+            return -1;
+        }
+    }
+    
+    int id = insertBlock(shardIndex, offset, size, type);
+    if (id == -1) {
+        allocator.release(offset, size);
+    }
+    return id;
+}
+
+int MemoryManager::insertBlock(size_t shardIndex, size_t offset, size_t size, const std::string& type) {
+    // Create a new memory block
+    int id = newSlot(shardIndex);
+    if (id == -1) {
+        std::cerr << "Block table is full" << std::endl;
+        return -1;
+    }
+    
+    BlockShard& shard = shards[shardIndex];
+    MemoryBlock* block = findBlock(shard, id);
+    block->offset = offset;
+    block->size = size;
+    block->typeId = internType(type);
+    shard.blocksByOffset[offset] = id;
+    if (wal) {
+        loggedLsn = wal->logCreate(id, size, type);
+    }
+    
+    // Let the dumper know the memory changed
+    recordMutation();
+    
+    return id;
+}
+
+MemoryBlock* MemoryManager::findBlock(BlockShard& shard, int id) {
+    uint32_t number = static_cast<uint32_t>(id) & SLOT_MASK;
+    if (id <= 0 || number == 0) {
+        return nullptr;
+    }
+    
+    uint32_t index = (number - 1) / shards.size();
+    if (index >= shard.slotCount) {
+        return nullptr;
+    }
+    
+    // A freed slot, or one that was reused since the ID was handed out
+    MemoryBlock& block = shard.slot(index);
+    if (!block.used || block.generation != static_cast<uint32_t>(id) >> SLOT_BITS) {
+        return nullptr;
+    }
+    return &block;
+}
+
+int MemoryManager::blockId(size_t shardIndex, uint32_t slot, uint8_t generation) const {
+    uint32_t number = static_cast<uint32_t>(slot * shards.size() + shardIndex + 1);
+    return static_cast<int>(static_cast<uint32_t>(generation) << SLOT_BITS | number);
+}
+
+int MemoryManager::newSlot(size_t shardIndex) {
+    BlockShard& shard = shards[shardIndex];
+    
+    // Reuse a freed slot under a new generation, so its old ID stays invalid
+    uint32_t index;
+    if (!shard.freeSlots.empty()) {
+        index = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+        MemoryBlock& block = shard.slot(index);
+        block.generation = (block.generation + 1) & GENERATION_MASK;
+    } else {
+        index = shard.slotCount;
+        if (static_cast<uint64_t>(index) * shards.size() + shardIndex + 1 > SLOT_MASK) {
+            return -1;
+        }
+        if (index % BlockShard::SLOTS_PER_PAGE == 0) {
+            shard.pages.push_back(std::make_unique<MemoryBlock[]>(BlockShard::SLOTS_PER_PAGE));
+        }
+        shard.slotCount++;
+    }
+    
+    MemoryBlock& block = shard.slot(index);
+    block.used = true;
+    block.refCount = 1;
+    block.pinCount = 0;
+    block.version = ++versionClock;
+    return blockId(shardIndex, index, block.generation);
+}
+
+MemoryBlock* MemoryManager::placeBlock(int id) {
+    // Startup only: put a block back under the ID it had, rebuildFreeSlots() must
+    // run once every block is in place
+    uint32_t number = static_cast<uint32_t>(id) & SLOT_MASK;
+    if (id <= 0 || number == 0) {
+        return nullptr;
+    }
+    
+    BlockShard& shard = shardFor(id);
+    uint32_t index = (number - 1) / shards.size();
+    while (shard.pages.size() <= index / BlockShard::SLOTS_PER_PAGE) {
+        shard.pages.push_back(std::make_unique<MemoryBlock[]>(BlockShard::SLOTS_PER_PAGE));
+    }
+    shard.slotCount = std::max(shard.slotCount, index + 1);
+    
+    MemoryBlock& block = shard.slot(index);
+    if (block.used) {
+        return nullptr;
+    }
+    block.generation = static_cast<uint32_t>(id) >> SLOT_BITS;
+    block.used = true;
+    block.refCount = 1;
+    block.pinCount = 0;
+    block.version = ++versionClock;
+    return &block;
+}
+
+void MemoryManager::freeSlot(BlockShard& shard, int id) {
+    uint32_t index = ((static_cast<uint32_t>(id) & SLOT_MASK) - 1) / shards.size();
+    shard.slot(index).used = false;
+    shard.freeSlots.push_back(index);
+}
+
+void MemoryManager::rebuildFreeSlots() {
+    for (auto& shard : shards) {
+        shard.freeSlots.clear();
+        for (uint32_t index = shard.slotCount; index > 0; index--) {
+            if (!shard.slot(index - 1).used) {
+                shard.freeSlots.push_back(index - 1);
+            }
+        }
+    }
+}
+
+uint32_t MemoryManager::internType(const std::string& type) {
+    {
+        std::shared_lock<std::shared_mutex> lock(typesMutex);
+        auto it = typeIds.find(type);
+        if (it != typeIds.end()) {
+            return it->second;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(typesMutex);
+    auto [it, inserted] = typeIds.emplace(type, static_cast<uint32_t>(typeNames.size()));
+    if (inserted) {
+        typeNames.push_back(type);
+    }
+    return it->second;
+}
+
+std::string MemoryManager::typeName(uint32_t typeId) {
+    std::shared_lock<std::shared_mutex> lock(typesMutex);
+    return typeNames[typeId];
+}
+
+size_t MemoryManager::allocateBlock(BlockShard& shard, size_t size) {
+    // Small blocks freed in this shard are reused without touching the shared allocator
+    if (size <= PoolAllocator::SMALL_LIMIT) {
+        size_t rounded = PoolAllocator::roundUp(size);
+        auto& freeList = shard.freeLists[rounded / PoolAllocator::ALIGNMENT - 1];
+        if (!freeList.empty()) {
+            size_t offset = freeList.back();
+            freeList.pop_back();
+            shard.cachedBytes -= rounded;
+            shardCachedBytes -= rounded;
+            return offset;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    return allocator.allocate(size);
+}
+
+void MemoryManager::releaseBlock(BlockShard& shard, size_t offset, size_t size) {
+    size_t rounded = PoolAllocator::roundUp(size);
+    if (poolFd == -1 && size <= PoolAllocator::SMALL_LIMIT && shard.cachedBytes + rounded <= SHARD_CACHE_BYTES) {
+        shard.freeLists[rounded / PoolAllocator::ALIGNMENT - 1].push_back(offset);
+        shard.cachedBytes += rounded;
+        shardCachedBytes += rounded;
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    freeExtent(offset, size);
+}
+
+void MemoryManager::freeExtent(size_t offset, size_t size) {
+    // A crash before the next checkpoint restores the table on disk, which may still
+    // point at this extent: a mapped pool must not hand it out again until then
+    if (poolFd != -1) {
+        quarantinedExtents.emplace_back(offset, size);
+    } else {
+        allocator.release(offset, size);
+    }
+}
+
+void MemoryManager::drainShardCaches() {
+    // Every shard and the allocator must be locked
+    for (auto& shard : shards) {
+        for (size_t i = 0; i < shard.freeLists.size(); i++) {
+            for (size_t offset : shard.freeLists[i]) {
+                allocator.release(offset, (i + 1) * PoolAllocator::ALIGNMENT);
+            }
+            shard.freeLists[i].clear();
+        }
+        shard.cachedBytes = 0;
+    }
+    shardCachedBytes = 0;
+}
+
+std::vector<std::unique_lock<std::shared_mutex>> MemoryManager::lockAllShards() {
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    locks.reserve(shards.size());
+    for (auto& shard : shards) {
+        locks.emplace_back(shard.mutex);
+    }
+    return locks;
+}
+
+size_t MemoryManager::countBlocks() {
+    size_t count = 0;
+    for (auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (uint32_t index = 0; index < shard.slotCount; index++) {
+            count += shard.slot(index).used ? 1 : 0;
+        }
+    }
+    return count;
+}
+
+bool MemoryManager::set(int id, const void* value, size_t valueSize, uint64_t* version) {
+    return setRange(id, 0, value, valueSize, version);
+}
+
+bool MemoryManager::setRange(int id, size_t offset, const void* value, size_t length, uint64_t* version) {
+    BlockShard& shard = shardFor(id);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    
+    MemoryBlock* block = findBlock(shard, id);
+    if (!block) {
+        return false;
+    }
+    
+    // Check if the range fits in the block
+    if (offset > block->size || length > block->size - offset) {
+        std::cerr << "Range of " << length << " bytes at " << offset << " exceeds block size " << block->size << std::endl;
+        return false;
+    }
+    
+    // Copy value to memory
+    char* dest = static_cast<char*>(memoryPool) + block->offset + offset;
+    std::memcpy(dest, value, length);
+    block->version = ++versionClock;
+    if (version) {
+        *version = block->version;
+    }
+    if (wal) {
+        loggedLsn = offset == 0 ? wal->logSet(id, static_cast<const char*>(value), length)
+                                : wal->logSetRange(id, offset, static_cast<const char*>(value), length);
+    }
+    
+    // Let the dumper know the memory changed
+    recordMutation();
+    
+    return true;
+}
+
+bool MemoryManager::get(int id, void* value, size_t valueSize, uint64_t* version, uint64_t knownVersion) {
+    BlockShard& shard = shardFor(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);  // GETs of the same shard run concurrently
+    
+    MemoryBlock* block = findBlock(shard, id);
+    if (!block) {
+        return false;
+    }
+    
+    // Check if sizes match
+    if (valueSize > block->size) {
+        std::cerr << "Value size " << valueSize << " exceeds block size " << block->size << std::endl;
+        return false;
+    }
+    
+    // The caller's copy is still current
+    if (version) {
+        *version = block->version;
+        if (block->version == knownVersion) {
+            return true;
+        }
+    }
+    
+    // Copy memory to value
+    char* src = static_cast<char*>(memoryPool) + block->offset;
+    std::memcpy(value, src, valueSize);
+    
+    return true;
+}
+
+bool MemoryManager::getRange(int id, size_t offset, void* value, size_t length) {
+    BlockShard& shard = shardFor(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    
+    MemoryBlock* block = findBlock(shard, id);
+    if (!block) {
+        return false;
+    }
+    
+    // Check if the range fits in the block
+    if (offset > block->size || length > block->size - offset) {
+        std::cerr << "Range of " << length << " bytes at " << offset << " exceeds block size " << block->size << std::endl;
+        return false;
+    }
+    
+    std::memcpy(value, static_cast<char*>(memoryPool) + block->offset + offset, length);
+    return true;
+}
+
+struct MemoryManager::ListHeader {
+    int32_t head;         // First node, -1 when empty
+    int32_t tail;         // Last node, -1 when empty
+    uint32_t count;
+    uint32_t nodeSize;
+    uint32_t nextOffset;  // Offsets of the links inside a node
+    uint32_t prevOffset;
+    uint32_t typeLength;  // Length of the node type name that follows
+};
+
+std::mutex& MemoryManager::listLock(int listId) {
+    return listLocks[(static_cast<uint32_t>(listId) & SLOT_MASK) % LIST_LOCKS];
+}
+
+bool MemoryManager::readListHeader(int listId, ListHeader& header, std::string* nodeType) {
+    BlockShard& shard = shardFor(listId);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    
+    MemoryBlock* block = findBlock(shard, listId);
+    if (!block || block->size < sizeof(ListHeader) || typeName(block->typeId) != LIST_TYPE) {
+        std::cerr << "Block " << listId << " is not a list" << std::endl;
+        return false;
+    }
+    
+    // The handle is an ordinary block a client can overwrite, check it before trusting it
+    const char* data = static_cast<const char*>(memoryPool) + block->offset;
+    std::memcpy(&header, data, sizeof(header));
+    if (!validNodeLayout(header.nodeSize, header.nextOffset, header.prevOffset)) {
+        std::cerr << "List " << listId << " has a corrupted header" << std::endl;
+        return false;
+    }
+    if (nodeType) {
+        nodeType->assign(data + sizeof(header), std::min<size_t>(header.typeLength, block->size - sizeof(header)));
+    }
+    return true;
+}
+
+bool MemoryManager::hasType(int id, uint32_t typeId) {
+    BlockShard& shard = shardFor(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    MemoryBlock* block = findBlock(shard, id);
+    return block && block->typeId == typeId;
+}
+
+bool MemoryManager::relink(int nodeId, size_t offset, int32_t target, int32_t& previous) {
+    return getRange(nodeId, offset, &previous, sizeof(previous)) &&
+           setRange(nodeId, offset, &target, sizeof(target));
+}
+
+int MemoryManager::listCreate(size_t nodeSize, size_t nextOffset, size_t prevOffset, const std::string& nodeType,
+                              Protocol::ListState& state) {
+    if (!validNodeLayout(nodeSize, nextOffset, prevOffset)) {
+        std::cerr << "Invalid list node layout: size " << nodeSize << ", links at " << nextOffset
+                  << " and " << prevOffset << std::endl;
+        return -1;
+    }
+    
+    ListHeader header = {-1, -1, 0, static_cast<uint32_t>(nodeSize), static_cast<uint32_t>(nextOffset),
+                         static_cast<uint32_t>(prevOffset), static_cast<uint32_t>(nodeType.size())};
+    std::vector<char> contents(sizeof(header) + nodeType.size());
+    std::memcpy(contents.data(), &header, sizeof(header));
+    std::memcpy(contents.data() + sizeof(header), nodeType.data(), nodeType.size());
+    
+    int listId = create(contents.size(), LIST_TYPE);
+    if (listId == -1) {
+        return -1;
+    }
+    if (!set(listId, contents.data(), contents.size())) {
+        decreaseRefCount(listId);
+        return -1;
+    }
+    
+    state = Protocol::ListState();
+    return listId;
+}
+
+int MemoryManager::listPush(int listId, bool front, const void* node, size_t nodeSize, Protocol::ListState& state) {
+    std::lock_guard<std::mutex> lock(listLock(listId));
+    
+    ListHeader header;
+    std::string nodeType;
+    if (!readListHeader(listId, header, &nodeType)) {
+        return -1;
+    }
+    if (nodeSize != header.nodeSize) {
+        std::cerr << "Node of " << nodeSize << " bytes for a list of " << header.nodeSize << " byte nodes" << std::endl;
+        return -1;
+    }
+    
+    // The new node is stored with its links already set
+    int32_t neighbor = front ? header.head : header.tail;
+    int32_t noNode = -1;
+    std::vector<char> contents(static_cast<const char*>(node), static_cast<const char*>(node) + nodeSize);
+    std::memcpy(contents.data() + header.nextOffset, front ? &neighbor : &noNode, sizeof(int32_t));
+    std::memcpy(contents.data() + header.prevOffset, front ? &noNode : &neighbor, sizeof(int32_t));
+    
+    int32_t nodeId = create(nodeSize, nodeType);
+    if (nodeId == -1) {
+        return -1;
+    }
+    if (!set(nodeId, contents.data(), nodeSize)) {
+        decreaseRefCount(nodeId);
+        return -1;
+    }
+    
+    // Link the old end of the list to it, then update the handle. If that fails the
+    // old link is put back, so the list stays as it was
+    size_t linkOffset = front ? header.prevOffset : header.nextOffset;
+    int32_t oldLink = -1;
+    if (neighbor != -1 && !relink(neighbor, linkOffset, nodeId, oldLink)) {
+        decreaseRefCount(nodeId);
+        return -1;
+    }
+    if (front) {
+        header.head = nodeId;
+    } else {
+        header.tail = nodeId;
+    }
+    if (neighbor == -1) {
+        header.head = header.tail = nodeId;
+    }
+    header.count++;
+    if (!setRange(listId, 0, &header, sizeof(header))) {
+        if (neighbor != -1) {
+            setRange(neighbor, linkOffset, &oldLink, sizeof(oldLink));
+        }
+        decreaseRefCount(nodeId);
+        return -1;
+    }
+    
+    state = {header.head, header.tail, header.count};
+    return nodeId;
+}
+
+int MemoryManager::listPopFront(int listId, Protocol::ListState& state) {
+    std::lock_guard<std::mutex> lock(listLock(listId));
+    
+    ListHeader header;
+    if (!readListHeader(listId, header)) {
+        return -1;
+    }
+    if (header.head == -1) {
+        std::cerr << "List " << listId << " is empty" << std::endl;
+        return -1;
+    }
+    
+    // Unlink the first node
+    int32_t removed = header.head;
+    int32_t next;
+    if (!getRange(removed, header.nextOffset, &next, sizeof(next))) {
+        return -1;
+    }
+    int32_t oldLink = -1;
+    if (next != -1 && !relink(next, header.prevOffset, -1, oldLink)) {
+        return -1;
+    }
+    header.head = next;
+    if (next == -1) {
+        header.tail = -1;
+    }
+    header.count--;
+    if (!setRange(listId, 0, &header, sizeof(header))) {
+        if (next != -1) {
+            setRange(next, header.prevOffset, &oldLink, sizeof(oldLink));  // The head stays first
+        }
+        return -1;
+    }
+    
+    // The list held the only reference the server knows about
+    decreaseRefCount(removed);
+    
+    state = {header.head, header.tail, header.count};
+    return removed;
+}
+
+int MemoryManager::listAppend(int listId, const void* nodes, size_t length, std::vector<int32_t>& ids,
+                              Protocol::ListState& state) {
+    std::lock_guard<std::mutex> lock(listLock(listId));
+    
+    ListHeader header;
+    std::string nodeType;
+    if (!readListHeader(listId, header, &nodeType)) {
+        return -1;
+    }
+    if (length == 0 || length % header.nodeSize != 0 || length / header.nodeSize > UINT32_MAX - header.count) {
+        std::cerr << length << " bytes are not whole nodes of " << header.nodeSize << " bytes" << std::endl;
+        return -1;
+    }
+    size_t count = length / header.nodeSize;
+    
+    // Allocate every node first, so each one is written once with both links set
+    auto releaseAll = [&] {
+        for (int32_t id : ids) {
+            decreaseRefCount(id);
+        }
+        ids.clear();
+    };
+    ids.clear();
+    ids.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        int32_t nodeId = create(header.nodeSize, nodeType);
+        if (nodeId == -1) {
+            releaseAll();
+            return -1;
+        }
+        ids.push_back(nodeId);
+    }
+    
+    std::vector<char> contents(header.nodeSize);
+    for (size_t i = 0; i < count; i++) {
+        int32_t prev = i > 0 ? ids[i - 1] : header.tail;
+        int32_t next = i + 1 < count ? ids[i + 1] : -1;
+        std::memcpy(contents.data(), static_cast<const char*>(nodes) + i * header.nodeSize, header.nodeSize);
+        std::memcpy(contents.data() + header.nextOffset, &next, sizeof(int32_t));
+        std::memcpy(contents.data() + header.prevOffset, &prev, sizeof(int32_t));
+        if (!set(ids[i], contents.data(), header.nodeSize)) {
+            releaseAll();
+            return -1;
+        }
+    }
+    
+    // Link the old tail to the first new node, then update the handle (as in listPush,
+    // a failure puts the old link back)
+    int32_t oldTail = header.tail;
+    int32_t oldLink = -1;
+    if (oldTail != -1 && !relink(oldTail, header.nextOffset, ids.front(), oldLink)) {
+        releaseAll();
+        return -1;
+    }
+    if (header.head == -1) {
+        header.head = ids.front();
+    }
+    header.tail = ids.back();
+    header.count += static_cast<uint32_t>(count);
+    if (!setRange(listId, 0, &header, sizeof(header))) {
+        if (oldTail != -1) {
+            setRange(oldTail, header.nextOffset, &oldLink, sizeof(oldLink));
+        }
+        releaseAll();
+        return -1;
+    }
+    
+    state = {header.head, header.tail, header.count};
+    return static_cast<int>(count);
+}
+
+int MemoryManager::listClear(int listId, Protocol::ListState& state) {
+    std::lock_guard<std::mutex> lock(listLock(listId));
+    
+    ListHeader header;
+    if (!readListHeader(listId, header)) {
+        return -1;
+    }
+    
+    // Walk the chain releasing each node (never more than `count`, in case of a cycle)
+    int32_t nodeId = header.head;
+    uint32_t released = 0;
+    while (nodeId != -1 && released < header.count) {
+        int32_t next;
+        if (!getRange(nodeId, header.nextOffset, &next, sizeof(next))) {
+            std::cerr << "List " << listId << " has no node " << nodeId << std::endl;
+            break;
+        }
+        decreaseRefCount(nodeId);
+        released++;
+        nodeId = next;
+    }
+    
+    header.head = header.tail = -1;
+    header.count = 0;
+    if (!setRange(listId, 0, &header, sizeof(header))) {
+        return -1;
+    }
+    
+    state = Protocol::ListState();
+    return static_cast<int>(released);
+}
+
+int MemoryManager::listTraverse(int listId, int startId, bool backward, size_t maxNodes, std::vector<char>& out) {
+    // The list lock keeps pushes and pops from relinking nodes under the walk
+    std::lock_guard<std::mutex> lock(listLock(listId));
+    
+    ListHeader header;
+    std::string nodeType;
+    if (!readListHeader(listId, header, &nodeType)) {
+        return -1;
+    }
+    
+    // The start node comes from the client and the links live in blocks clients can
+    // write, so only blocks of the list's node type are walked
+    uint32_t nodeTypeId = internType(nodeType);
+    
+    // A list never has more than `count` nodes, a longer walk would be a cycle
+    const size_t entrySize = sizeof(int32_t) + header.nodeSize;
+    size_t limit = std::min<size_t>(maxNodes, header.count);
+    int32_t nodeId = startId != -1 ? startId : (backward ? header.tail : header.head);
+    int count = 0;
+    
+    while (nodeId != -1 && static_cast<size_t>(count) < limit && out.size() + entrySize <= Protocol::MAX_PAYLOAD) {
+        size_t start = out.size();
+        out.resize(start + entrySize);
+        Protocol::putU32(reinterpret_cast<uint8_t*>(out.data() + start), static_cast<uint32_t>(nodeId));
+        
+        char* node = out.data() + start + sizeof(int32_t);
+        if (!hasType(nodeId, nodeTypeId) || !get(nodeId, node, header.nodeSize)) {
+            std::cerr << "List " << listId << " has no node " << nodeId << std::endl;
+            return -1;
+        }
+        std::memcpy(&nodeId, node + (backward ? header.prevOffset : header.nextOffset), sizeof(nodeId));
+        count++;
+    }
+    return count;
+}
+
+bool MemoryManager::increaseRefCount(int id) {
+    return adjustRefCount(id, 1);
+}
+
+bool MemoryManager::decreaseRefCount(int id) {
+    return adjustRefCount(id, -1);
+}
+
+bool MemoryManager::adjustRefCount(int id, int delta) {
+    BlockShard& shard = shardFor(id);
+    
+    // The count is atomic, the shared lock only keeps the slot from being freed or
+    // reused meanwhile. The log needs its records in the order the counts changed,
+    // so with a log the lock is exclusive
+    std::shared_lock<std::shared_mutex> sharedLock(shard.mutex, std::defer_lock);
+    std::unique_lock<std::shared_mutex> exclusiveLock(shard.mutex, std::defer_lock);
+    if (wal) {
+        exclusiveLock.lock();
+    } else {
+        sharedLock.lock();
+    }
+    
+    MemoryBlock* block = findBlock(shard, id);
+    if (!block) {
+        return false;
+    }
+    
+    int count = block->refCount.fetch_add(delta, std::memory_order_acq_rel) + delta;
+    if (wal) {
+        loggedLsn = wal->logRefCount(id, count);
+    }
+    
+    // Only the drop to zero goes to the garbage collector. It checks the count again
+    // under the exclusive lock before freeing, so an increment racing with it wins
+    if (count <= 0 && count - delta > 0) {
+        scheduleReclaim(id);
+    }
+    
+    // Reference counts are part of the dumps and the checkpoints
+    recordMutation();
+    
+    return true;
+}
+
+bool MemoryManager::setupListener() {
+    struct sockaddr_in serverAddr;
+    
+    // Create socket (non-blocking, the reactor accepts until EAGAIN)
+    serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (serverSocket < 0) {
+        std::cerr << "Error creating socket" << std::endl;
+        return false;
+    }
+    
+    // Set socket options
+    int opt = 1;
+    if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        std::cerr << "Error setting socket options" << std::endl;
+        return false;
+    }
+    
+    // Setup server address
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
+    
+    // Bind socket
+    if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        std::cerr << "Error binding socket to port " << port << std::endl;
+        return false;
+    }
+    
+    // Listen for connections
+    if (listen(serverSocket, SOMAXCONN) < 0) {
+        std::cerr << "Error listening on socket" << std::endl;
+        return false;
+    }
+    
+    // Create the epoll instance and the shutdown wakeup descriptor
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeupFd < 0) {
+        std::cerr << "Error creating epoll instance" << std::endl;
+        return false;
+    }
+    
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = serverSocket;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &event) < 0) {
+        std::cerr << "Error registering server socket" << std::endl;
+        return false;
+    }
+    
+    event.data.fd = wakeupFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event) < 0) {
+        std::cerr << "Error registering wakeup descriptor" << std::endl;
+        return false;
+    }
+    
+    std::cout << "Memory Manager listening on port " << port << std::endl;
+    return true;
+}
+
+char* MemoryManager::pinBlock(int id, size_t size) {
+    BlockShard& shard = shardFor(id);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    
+    MemoryBlock* block = findBlock(shard, id);
+    if (!block) {
+        return nullptr;
+    }
+    
+    if (size > block->size) {
+        std::cerr << "Value size " << size << " exceeds block size " << block->size << std::endl;
+        return nullptr;
+    }
+    
+    if (block->pinCount == MemoryBlock::MAX_PINS) {
+        std::cerr << "Too many transfers in progress on block " << id << std::endl;
+        return nullptr;
+    }
+    
+    block->pinCount++;
+    return static_cast<char*>(memoryPool) + block->offset;
+}
+
+void MemoryManager::unpinBlock(int id, bool written) {
+    BlockShard& shard = shardFor(id);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    
+    MemoryBlock* block = findBlock(shard, id);
+    if (!block) {
+        return;
+    }
+    
+    block->pinCount--;
+    
+    // The block lost its last reference while it was being streamed
+    if (block->pinCount == 0 && block->refCount <= 0) {
+        scheduleReclaim(id);
+    }
+    
+    if (written) {
+        block->version = ++versionClock;
+        
+        // The value went straight into the pool, log the whole block
+        if (wal) {
+            loggedLsn = wal->logSet(id, static_cast<const char*>(memoryPool) + block->offset, block->size);
+        }
+        
+        // Let the dumper know the memory changed
+        recordMutation();
+    }
+}
+
+void MemoryManager::serverLoop() {
+    const int maxEvents = 64;
+    struct epoll_event events[maxEvents];
+    
+    // Reactor: wait for new connections and for requests on open ones,
+    // requests are handed to the worker threads
+    while (running) {
+        int ready = epoll_wait(epollFd, events, maxEvents, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error waiting for events" << std::endl;
+            break;
+        }
+        
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            
+            if (fd == wakeupFd) {
+                // stopServer() asked us to finish
+                continue;
+            }
+            
+            if (fd == serverSocket) {
+                acceptConnections();
+                continue;
+            }
+            
+            // A request (or a hang up) on a client connection. The connection is
+            // registered with EPOLLONESHOT, so only one worker gets it at a time
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                readyConnections.push_back(fd);
+            }
+            queueCondition.notify_one();
+        }
+    }
+}
+
+void MemoryManager::acceptConnections() {
+    struct sockaddr_in clientAddr;
+    socklen_t clientLen = sizeof(clientAddr);
+    
+    while (true) {
+        int clientSocket = accept4(serverSocket, (struct sockaddr*)&clientAddr, &clientLen, SOCK_CLOEXEC);
+        if (clientSocket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error accepting connection" << std::endl;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        
+        // Requests are small and answered right away, don't let Nagle delay them
+        int opt = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections.insert(clientSocket);
+        }
+        
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+            std::cerr << "Error registering client connection" << std::endl;
+            closeConnection(clientSocket);
+            continue;
+        }
+        
+        trace("Connection accepted from ", inet_ntoa(clientAddr.sin_addr), ":", ntohs(clientAddr.sin_port));
+    }
+}
+
+void MemoryManager::workerLoop() {
+    while (true) {
+        int clientSocket;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return !running || !readyConnections.empty(); });
+            if (!running) {
+                return;
+            }
+            clientSocket = readyConnections.front();
+            readyConnections.pop_front();
+        }
+        
+        if (!handleRequest(clientSocket)) {
+            // Peer closed the connection (or sent a broken frame)
+            closeConnection(clientSocket);
+            continue;
+        }
+        
+        // Re-arm the connection for its next request
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, clientSocket, &event) < 0) {
+            closeConnection(clientSocket);
+        }
+    }
+}
+
+void MemoryManager::closeConnection(int clientSocket) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    if (connections.erase(clientSocket) > 0) {
+        // Closing the descriptor also removes it from the epoll set
+        close(clientSocket);
+    }
+}
+
+bool MemoryManager::handleRequest(int clientSocket) {
+    Protocol::Header request;
+    if (!Protocol::recvHeader(clientSocket, request)) {
+        return false;
+    }
+    
+    // Large values go straight between the socket and the pool
+    if (request.type == MessageType::SET && request.payloadLength > Protocol::STREAM_THRESHOLD) {
+        return streamSet(clientSocket, request);
+    }
+    if (request.type == MessageType::GET && request.size > Protocol::STREAM_THRESHOLD) {
+        return streamGet(clientSocket, request);
+    }
+    
+    if (request.payloadLength > Protocol::MAX_PAYLOAD) {
+        return false;
+    }
+    
+    // Receive the payload into a per-thread buffer that is reused between requests
+    thread_local std::vector<char> payload;
+    payload.resize(request.payloadLength);
+    if (!Protocol::recvAll(clientSocket, payload.data(), payload.size())) {
+        return false;
+    }
+    
+    // Initialize response
+    Protocol::Header response;
+    thread_local std::vector<char> responseData;
+    responseData.clear();
+    
+    if (request.type == MessageType::BATCH) {
+        processBatch(request, payload.data(), response, responseData);
+    } else {
+        processRequest(request, payload.data(), response, responseData);
+    }
+    
+    // Send response, the connection stays open for the next request
+    commitLog();
+    response.payloadLength = static_cast<uint32_t>(responseData.size());
+    return Protocol::sendFrame(clientSocket, response, responseData.data());
+}
+
+void MemoryManager::processRequest(const Protocol::Header& request, const char* payload,
+                                   Protocol::Header& response, std::vector<char>& responseData) {
+    // Process message
+    trace("Received message type: ", (int)request.type);
+    
+    response.type = request.type;
+    response.id = request.id;
+    
+    // Process based on message type
+    switch (request.type) {
+        case MessageType::CREATE:
+            response.id = create(request.size, std::string(payload, request.payloadLength));
+            trace("Created block with ID: ", response.id);
+            break;
+            
+        case MessageType::SET:
+            if (set(request.id, payload, request.payloadLength, &response.size)) {
+                trace("Set value for ID: ", request.id);
+            } else {
+                std::cerr << "Failed to set value for ID: " << request.id << std::endl;
+                response.id = -1;
+            }
+            break;
+            
+        case MessageType::GET:
+        case MessageType::GET_IF_MODIFIED: {
+            uint64_t knownVersion = 0;
+            if (request.type == MessageType::GET_IF_MODIFIED && request.payloadLength == 8) {
+                knownVersion = Protocol::getU64(reinterpret_cast<const uint8_t*>(payload));
+            }
+            
+            // The value is appended to the response data
+            size_t start = responseData.size();
+            if (request.size <= Protocol::MAX_PAYLOAD - start) {
+                responseData.resize(start + request.size);
+            }
+            if (responseData.size() == start + request.size &&
+                get(request.id, responseData.data() + start, request.size, &response.size, knownVersion)) {
+                if (knownVersion != 0 && response.size == knownVersion) {
+                    responseData.resize(start);
+                    response.status = Protocol::Status::NOT_MODIFIED;
+                    trace("Value not modified for ID: ", request.id);
+                } else {
+                    trace("Got value for ID: ", request.id);
+                }
+            } else {
+                std::cerr << "Failed to get value for ID: " << request.id << std::endl;
+                responseData.resize(start);
+                response.id = -1;
+            }
+            break;
+        }
+            
+        case MessageType::GET_RANGE: {
+            size_t start = responseData.size();
+            bool valid = request.payloadLength == Protocol::RANGE_OFFSET_SIZE &&
+                         request.size <= Protocol::MAX_PAYLOAD - start;
+            if (valid) {
+                responseData.resize(start + request.size);
+            }
+            if (valid && getRange(request.id, Protocol::getU64(reinterpret_cast<const uint8_t*>(payload)),
+                                  responseData.data() + start, request.size)) {
+                trace("Got range of ID: ", request.id);
+            } else {
+                std::cerr << "Failed to get range of ID: " << request.id << std::endl;
+                responseData.resize(start);
+                response.id = -1;
+            }
+            break;
+        }
+            
+        case MessageType::SET_RANGE:
+            if (request.payloadLength >= Protocol::RANGE_OFFSET_SIZE &&
+                setRange(request.id, Protocol::getU64(reinterpret_cast<const uint8_t*>(payload)),
+                         payload + Protocol::RANGE_OFFSET_SIZE, request.payloadLength - Protocol::RANGE_OFFSET_SIZE,
+                         &response.size)) {
+                trace("Set range of ID: ", request.id);
+            } else {
+                std::cerr << "Failed to set range of ID: " << request.id << std::endl;
+                response.id = -1;
+            }
+            break;
+            
+        case MessageType::LIST_CREATE:
+        case MessageType::LIST_PUSH_BACK:
+        case MessageType::LIST_PUSH_FRONT:
+        case MessageType::LIST_POP_FRONT:
+        case MessageType::LIST_CLEAR: {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(payload);
+            Protocol::ListState state;
+            if (request.type == MessageType::LIST_CREATE) {
+                response.id = request.payloadLength >= 8
+                    ? listCreate(request.size, Protocol::getU32(data), Protocol::getU32(data + 4),
+                                 std::string(payload + 8, request.payloadLength - 8), state)
+                    : -1;
+            } else if (request.type == MessageType::LIST_POP_FRONT) {
+                response.id = listPopFront(request.id, state);
+            } else if (request.type == MessageType::LIST_CLEAR) {
+                response.id = listClear(request.id, state);
+            } else {
+                response.id = listPush(request.id, request.type == MessageType::LIST_PUSH_FRONT,
+                                       payload, request.payloadLength, state);
+            }
+            
+            if (response.id != -1) {
+                // The new state of the list is appended to the response data
+                size_t start = responseData.size();
+                responseData.resize(start + Protocol::LIST_STATE_SIZE);
+                Protocol::encodeListState(state, reinterpret_cast<uint8_t*>(responseData.data() + start));
+                trace("List request ", (int)request.type, " returned ID: ", response.id);
+            } else {
+                std::cerr << "Failed list request " << (int)request.type << " for ID: " << request.id << std::endl;
+            }
+            break;
+        }
+            
+        case MessageType::LIST_APPEND: {
+            // The state of the list and the IDs of the new nodes are appended to the response data
+            Protocol::ListState state;
+            std::vector<int32_t> ids;
+            response.id = listAppend(request.id, payload, request.payloadLength, ids, state);
+            
+            if (response.id != -1) {
+                size_t start = responseData.size();
+                responseData.resize(start + Protocol::LIST_STATE_SIZE + ids.size() * sizeof(int32_t));
+                uint8_t* data = reinterpret_cast<uint8_t*>(responseData.data() + start);
+                Protocol::encodeListState(state, data);
+                for (size_t i = 0; i < ids.size(); i++) {
+                    Protocol::putU32(data + Protocol::LIST_STATE_SIZE + i * sizeof(int32_t), static_cast<uint32_t>(ids[i]));
+                }
+                trace("Appended ", response.id, " nodes to list ", request.id);
+            } else {
+                std::cerr << "Failed to append to list " << request.id << std::endl;
+            }
+            break;
+        }
+            
+        case MessageType::LIST_TRAVERSE: {
+            // The nodes are appended to the response data
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(payload);
+            size_t start = responseData.size();
+            response.id = request.payloadLength == Protocol::TRAVERSE_REQUEST_SIZE
+                ? listTraverse(request.id, static_cast<int32_t>(Protocol::getU32(data)),
+                               Protocol::getU32(data + 4) == Protocol::TRAVERSE_BACKWARD, request.size, responseData)
+                : -1;
+            
+            if (response.id != -1) {
+                trace("Traversed ", response.id, " nodes of list ", request.id);
+            } else {
+                std::cerr << "Failed to traverse list " << request.id << std::endl;
+                responseData.resize(start);
+            }
+            break;
+        }
+            
+        case MessageType::INCREASE_REF_COUNT:
+            if (increaseRefCount(request.id)) {
+                trace("Increased ref count for ID: ", request.id);
+            } else {
+                std::cerr << "Failed to increase ref count for ID: " << request.id << std::endl;
+                response.id = -1;
+            }
+            break;
+            
+        case MessageType::DECREASE_REF_COUNT:
+            if (decreaseRefCount(request.id)) {
+                trace("Decreased ref count for ID: ", request.id);
+            } else {
+                std::cerr << "Failed to decrease ref count for ID: " << request.id << std::endl;
+                response.id = -1;
+            }
+            break;
+            
+        case MessageType::DUMP:
+            requestDump();
+            trace("Memory dump requested");
+            break;
+            
+        case MessageType::SNAPSHOT:
+            if (!options.snapshotFile.empty() && saveSnapshot(options.snapshotFile)) {
+                trace("Snapshot saved on request");
+            } else {
+                std::cerr << "Failed to save snapshot" << std::endl;
+                response.id = -1;
+            }
+            break;
+            
+        default:
+            std::cerr << "Unknown message type: " << (int)request.type << std::endl;
+            response.id = -1;
+            break;
+    }
+    
+    if (response.id == -1) {
+        response.status = Protocol::Status::ERROR;
+    }
+}
+
+void MemoryManager::processBatch(const Protocol::Header& request, const char* payload,
+                                 Protocol::Header& response, std::vector<char>& responseData) {
+    response.type = MessageType::BATCH;
+    response.id = 0;  // Number of requests served
+    
+    // IDs returned so far, so later requests can refer to blocks created in this batch
+    std::vector<int> results;
+    
+    size_t position = 0;
+    while (position < request.payloadLength) {
+        Protocol::Header subRequest;
+        if (request.payloadLength - position < Protocol::HEADER_SIZE ||
+            !Protocol::decodeHeader(reinterpret_cast<const uint8_t*>(payload + position), subRequest) ||
+            subRequest.payloadLength > request.payloadLength - position - Protocol::HEADER_SIZE ||
+            subRequest.type == MessageType::BATCH) {
+            std::cerr << "Malformed batch request" << std::endl;
+            response.status = Protocol::Status::ERROR;
+            return;
+        }
+        const char* subPayload = payload + position + Protocol::HEADER_SIZE;
+        position += Protocol::HEADER_SIZE + subRequest.payloadLength;
+        
+        // Resolve a reference to the result of an earlier request
+        if (subRequest.flags & Protocol::FLAG_ID_FROM_RESULT) {
+            size_t index = static_cast<size_t>(subRequest.id);
+            subRequest.id = index < results.size() ? results[index] : -1;
+        }
+        
+        // Leave room for the sub-response header, its data is appended right after it
+        size_t headerPosition = responseData.size();
+        responseData.resize(headerPosition + Protocol::HEADER_SIZE);
+        
+        Protocol::Header subResponse;
+        if (subRequest.flags & Protocol::FLAG_ID_FROM_RESULT && subRequest.id == -1) {
+            subResponse.type = subRequest.type;
+            subResponse.status = Protocol::Status::ERROR;
+        } else {
+            processRequest(subRequest, subPayload, subResponse, responseData);
+        }
+        subResponse.payloadLength = static_cast<uint32_t>(responseData.size() - headerPosition - Protocol::HEADER_SIZE);
+        Protocol::encodeHeader(subResponse, reinterpret_cast<uint8_t*>(responseData.data() + headerPosition));
+        
+        if (subResponse.status == Protocol::Status::ERROR) {
+            response.status = Protocol::Status::ERROR;
+        }
+        results.push_back(subResponse.id);
+        response.id++;
+    }
+}
+
+bool MemoryManager::streamSet(int clientSocket, const Protocol::Header& request) {
+    Protocol::Header response;
+    response.type = request.type;
+    response.id = request.id;
+    
+    // Receive the value directly into the block
+    char* dest = pinBlock(request.id, request.payloadLength);
+    if (dest) {
+        bool received = Protocol::recvAll(clientSocket, dest, request.payloadLength);
+        unpinBlock(request.id, received);
+        if (!received) {
+            return false;
+        }
+        commitLog();
+        trace("Set value for ID: ", request.id, " (", request.payloadLength, " bytes streamed)");
+    } else {
+        std::cerr << "Failed to set value for ID: " << request.id << std::endl;
+        if (!Protocol::skipAll(clientSocket, request.payloadLength)) {
+            return false;
+        }
+        response.id = -1;
+        response.status = Protocol::Status::ERROR;
+    }
+    
+    return Protocol::sendFrame(clientSocket, response, nullptr);
+}
+
+bool MemoryManager::streamGet(int clientSocket, const Protocol::Header& request) {
+    Protocol::Header response;
+    response.type = request.type;
+    response.id = request.id;
+    
+    if (request.payloadLength > 0 && !Protocol::skipAll(clientSocket, request.payloadLength)) {
+        return false;
+    }
+    
+    // Send the value directly from the block
+    const char* src = request.size <= UINT32_MAX ? pinBlock(request.id, request.size) : nullptr;
+    if (!src) {
+        std::cerr << "Failed to get value for ID: " << request.id << std::endl;
+        response.id = -1;
+        response.status = Protocol::Status::ERROR;
+        return Protocol::sendFrame(clientSocket, response, nullptr);
+    }
+    
+    response.payloadLength = static_cast<uint32_t>(request.size);
+    bool sent = Protocol::sendFrame(clientSocket, response, src);
+    unpinBlock(request.id, false);
+    
+    trace("Got value for ID: ", request.id, " (", request.size, " bytes streamed)");
+    return sent;
+}
+
+void MemoryManager::scheduleReclaim(int id) {
+    {
+        std::lock_guard<std::mutex> lock(reclaimMutex);
+        reclaimQueue.push_back(id);
+    }
+    reclaimCondition.notify_one();
+}
+
+void MemoryManager::garbageCollector() {
+    std::vector<int> pending;
+    
+    while (true) {
+        // Sleep until some block loses its last reference
+        {
+            std::unique_lock<std::mutex> lock(reclaimMutex);
+            reclaimCondition.wait(lock, [this] { return !running || !reclaimQueue.empty(); });
+            if (!running) {
+                break;
+            }
+            pending.assign(reclaimQueue.begin(), reclaimQueue.end());
+            reclaimQueue.clear();
+        }
+        
+        for (int id : pending) {
+            BlockShard& shard = shardFor(id);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            MemoryBlock* block = findBlock(shard, id);
+            
+            // Referenced again, already freed, or still being streamed (unpinBlock reschedules it)
+            if (!block || block->refCount > 0 || block->pinCount > 0) {
+                continue;
+            }
+            
+            trace("Garbage collector freeing block ", id);
+            releaseBlock(shard, block->offset, block->size);
+            shard.blocksByOffset.erase(block->offset);
+            freeSlot(shard, id);
+            if (wal) {
+                wal->logFree(id);
+            }
+        }
     }
-    
-    std::cout << "Memory pool of " << sizeInMB << "MB allocated at " << memoryPool << std::endl;
 }
 
-MemoryManager::~MemoryManager() {
-    stopServer();
-    
-    // Free the memory pool
-    if (memoryPool) {
-        free(memoryPool);
-        memoryPool = nullptr;
+void MemoryManager::recordMutation() {
+    changeCount++;
+    size_t mutations = ++pendingMutations;
+    if (options.dumpEveryMutations > 0 && mutations == options.dumpEveryMutations) {
+        std::lock_guard<std::mutex> lock(dumpMutex);
+        dumpCondition.notify_one();
     }
 }
 
-bool MemoryManager::startServer() {
-    running = true;
-    
-    // Start server thread
-    serverThread = std::thread(&MemoryManager::serverLoop, this);
-    
-    // Start garbage collector thread
-    gcThread = std::thread(&MemoryManager::garbageCollector, this);
-    
-    return true;
-}
-
-void MemoryManager::stopServer() {
-    running = false;
-    
-    // Wait for threads to finish
-    if (serverThread.joinable()) {
-        serverThread.join();
-    }
-    
-    if (gcThread.joinable()) {
-        gcThread.join();
+void MemoryManager::requestDump() {
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex);
+        dumpRequested = true;
     }
+    dumpCondition.notify_one();
 }
 
-int MemoryManager::create(size_t size, const std::string& type) {
-    std::lock_guard<std::mutex> lock(blocksMutex);
+void MemoryManager::dumper() {
+    auto interval = options.dumpIntervalMs > 0 ? std::chrono::milliseconds(options.dumpIntervalMs)
+                                               : std::chrono::milliseconds::max();
+    auto nextPeriodicDump = std::chrono::steady_clock::now() + interval;
     
-    // Find free space in the memory pool
-    size_t offset = findFreeSpace(size);
-    if (offset == std::numeric_limits<size_t>::max()) {
-        // Try to defragment and find space again
-        defragmentMemory();
-        offset = findFreeSpace(size);
+    std::unique_lock<std::mutex> lock(dumpMutex);
+    while (running) {
+        auto mutationLimitReached = [this] {
+            return options.dumpEveryMutations > 0 && pendingMutations >= options.dumpEveryMutations;
+        };
+        auto wakeUp = [&] { return !running || dumpRequested || mutationLimitReached(); };
         
-        if (offset == std::numeric_limits<size_t>::max()) {
-            std::cerr << "Failed to allocate " << size << " bytes for type " << type << std::endl;
-            return -1;
+        if (options.dumpIntervalMs > 0) {
+            dumpCondition.wait_until(lock, nextPeriodicDump, wakeUp);
+        } else {
+            dumpCondition.wait(lock, wakeUp);
         }
+        if (!running) {
+            break;
+        }
+        
+        // Periodic dumps are skipped when nothing changed
+        bool periodic = options.dumpIntervalMs > 0 && std::chrono::steady_clock::now() >= nextPeriodicDump;
+        if (periodic) {
+            nextPeriodicDump = std::chrono::steady_clock::now() + interval;
+        }
+        if (!dumpRequested && !mutationLimitReached() && !(periodic && pendingMutations > 0)) {
+            continue;
+        }
+        dumpRequested = false;
+        
+        lock.unlock();
+        createMemoryDump();
+        lock.lock();
     }
+    lock.unlock();
     
-    // Create a new memory block
-    int id = nextId++;
-    blocks.emplace(id, MemoryBlock(offset, size, type));
-    
-    // Create memory dump
-    createMemoryDump();
-    
-    return id;
+    // Keep the last state on disk
+    if (pendingMutations > 0) {
+        createMemoryDump();
+    }
 }
 
-bool MemoryManager::set(int id, const void* value, size_t valueSize) {
-    std::lock_guard<std::mutex> lock(blocksMutex);
+Snapshot MemoryManager::takeSnapshot(bool withContents, std::vector<char>& contents, uint64_t* logSegment) {
+    Snapshot snapshot;
+    snapshot.poolSize = poolSize;
+    snapshot.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
     
-    auto it = blocks.find(id);
-    if (it == blocks.end() || !it->second.inUse) {
-        return false;
+    // Nothing changes while every shard is locked, readers may go on
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(shards.size());
+    for (auto& shard : shards) {
+        locks.emplace_back(shard.mutex);
     }
     
-    // Check if sizes match
-    if (valueSize > it->second.size) {
-        std::cerr << "Value size " << valueSize << " exceeds block size " << it->second.size << std::endl;
-        return false;
+    snapshot.nextId = 1;
+    for (size_t shardIndex = 0; shardIndex < shards.size(); shardIndex++) {
+        BlockShard& shard = shards[shardIndex];
+        for (uint32_t index = 0; index < shard.slotCount; index++) {
+            const MemoryBlock& block = shard.slot(index);
+            if (!block.used) {
+                continue;
+            }
+            int id = blockId(shardIndex, index, block.generation);
+            snapshot.blocks.push_back({id, block.offset, block.size, block.refCount, typeName(block.typeId)});
+            snapshot.poolBytes = std::max(snapshot.poolBytes, block.offset + block.size);
+            snapshot.nextId = std::max(snapshot.nextId, id + 1);
+        }
     }
+    std::sort(snapshot.blocks.begin(), snapshot.blocks.end(),
+              [](const SnapshotBlock& a, const SnapshotBlock& b) { return a.id < b.id; });
     
-    // Copy value to memory
-    char* dest = static_cast<char*>(memoryPool) + it->second.offset;
-    std::memcpy(dest, value, valueSize);
+    // Copy the pool up to the end of the last block, the file is written after the lock is released
+    if (withContents) {
+        const char* pool = static_cast<const char*>(memoryPool);
+        contents.assign(pool, pool + snapshot.poolBytes);
+    } else {
+        snapshot.poolBytes = 0;
+    }
     
-    // Create memory dump
-    createMemoryDump();
+    // Start a new log segment at this exact point, the older ones become redundant
+    // once the snapshot is on disk
+    if (logSegment) {
+        *logSegment = wal->rotate();
+    }
     
-    return true;
+    return snapshot;
 }
 
-bool MemoryManager::get(int id, void* value, size_t valueSize) {
-    std::lock_guard<std::mutex> lock(blocksMutex);
+bool MemoryManager::saveSnapshot(const std::string& path) {
+    std::vector<char> contents;
+    Snapshot snapshot = takeSnapshot(true, contents);
     
-    auto it = blocks.find(id);
-    if (it == blocks.end() || !it->second.inUse) {
+    if (!snapshot.save(path, contents.data())) {
         return false;
     }
     
-    // Check if sizes match
-    if (valueSize > it->second.size) {
-        std::cerr << "Value size " << valueSize << " exceeds block size " << it->second.size << std::endl;
+    std::cout << "Snapshot of " << snapshot.blocks.size() << " blocks saved to " << path << std::endl;
+    return true;
+}
+
+bool MemoryManager::loadSnapshot(const std::string& path) {
+    Snapshot snapshot;
+    if (!snapshot.load(path, static_cast<char*>(memoryPool), poolSize) || !restoreBlocks(snapshot)) {
         return false;
     }
     
-    // Copy memory to value
-    char* src = static_cast<char*>(memoryPool) + it->second.offset;
-    std::memcpy(value, src, valueSize);
-    
+    std::cout << "Recovered " << snapshot.blocks.size() << " blocks from snapshot " << path << std::endl;
     return true;
 }
 
-bool MemoryManager::increaseRefCount(int id) {
-    std::lock_guard<std::mutex> lock(blocksMutex);
-    
-    auto it = blocks.find(id);
-    if (it == blocks.end() || !it->second.inUse) {
-        return false;
+bool MemoryManager::restoreBlocks(const Snapshot& snapshot) {
+    auto locks = lockAllShards();
+    std::lock_guard<std::mutex> allocatorLock(allocatorMutex);
+    for (auto& shard : shards) {
+        shard.pages.clear();
+        shard.slotCount = 0;
+        shard.blocksByOffset.clear();
     }
+    drainShardCaches();
+    quarantinedExtents.clear();
     
-    it->second.refCount++;
+    std::vector<std::pair<size_t, size_t>> usedExtents;
+    for (const auto& saved : snapshot.blocks) {
+        if (saved.size > MemoryBlock::MAX_SIZE || saved.offset + saved.size > poolSize) {
+            std::cerr << "Block " << saved.id << " of the snapshot doesn't fit in the pool" << std::endl;
+            return false;
+        }
+        
+        MemoryBlock* block = placeBlock(saved.id);
+        if (!block) {
+            std::cerr << "Invalid or duplicate block ID " << saved.id << " in the snapshot" << std::endl;
+            return false;
+        }
+        block->offset = saved.offset;
+        block->size = saved.size;
+        block->refCount = saved.refCount;
+        block->typeId = internType(saved.type);
+        shardFor(saved.id).blocksByOffset[saved.offset] = saved.id;
+        usedExtents.emplace_back(saved.offset, saved.size);
+        
+        // Blocks that were waiting for the garbage collector
+        if (saved.refCount <= 0) {
+            reclaimQueue.push_back(saved.id);
+        }
+    }
+    allocator.rebuild(usedExtents);
+    rebuildFreeSlots();
     return true;
 }
 
-bool MemoryManager::decreaseRefCount(int id) {
-    std::lock_guard<std::mutex> lock(blocksMutex);
-    
-    auto it = blocks.find(id);
-    if (it == blocks.end() || !it->second.inUse) {
+bool MemoryManager::mapPool() {
+    poolFd = open(poolFilePath().c_str(), O_RDWR | O_CREAT, 0644);
+    if (poolFd == -1) {
+        std::cerr << "Failed to open pool file " << poolFilePath() << ": " << strerror(errno) << std::endl;
         return false;
     }
     
-    it->second.refCount--;
+    // A pool file of an earlier run keeps its contents, new space reads as zeros
+    struct stat fileStat;
+    if (fstat(poolFd, &fileStat) != 0 ||
+        (static_cast<size_t>(fileStat.st_size) != poolSize && ftruncate(poolFd, poolSize) != 0)) {
+        std::cerr << "Failed to size pool file " << poolFilePath() << ": " << strerror(errno) << std::endl;
+        close(poolFd);
+        poolFd = -1;
+        return false;
+    }
     
-    // Create memory dump
-    createMemoryDump();
+    int flags = MAP_SHARED;
+    if (options.populatePool) {
+        flags |= MAP_POPULATE;
+    }
+    void* mapping = mmap(nullptr, poolSize, PROT_READ | PROT_WRITE, flags, poolFd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map pool file " << poolFilePath() << ": " << strerror(errno) << std::endl;
+        close(poolFd);
+        poolFd = -1;
+        return false;
+    }
+    memoryPool = mapping;
     
+    // MAP_HUGETLB only works for anonymous and hugetlbfs mappings, a file mapping can only
+    // ask for transparent huge pages (honoured e.g. when the dump folder is on tmpfs)
+    if (options.hugePages && madvise(memoryPool, poolSize, MADV_HUGEPAGE) != 0) {
+        std::cerr << "Huge pages not available for the pool: " << strerror(errno) << std::endl;
+    }
     return true;
 }
 
-void MemoryManager::serverLoop() {
-    int serverSocket, clientSocket;
-    struct sockaddr_in serverAddr, clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
+void MemoryManager::unmapPool() {
+    munmap(memoryPool, poolSize);
+    memoryPool = nullptr;
+    close(poolFd);
+    poolFd = -1;
+}
+
+bool MemoryManager::checkpoint() {
+    std::lock_guard<std::mutex> checkpointLock(checkpointWriteMutex);
     
-    // Create socket
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket < 0) {
-        std::cerr << "Error creating socket" << std::endl;
-        return;
+    // Write most of the dirty pages before anything is held
+    if (msync(memoryPool, poolSize, MS_SYNC) != 0) {
+        std::cerr << "Failed to sync pool file: " << strerror(errno) << std::endl;
+        return false;
     }
     
-    // Set socket options
-    int opt = 1;
-    if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "Error setting socket options" << std::endl;
-        close(serverSocket);
-        return;
+    // No block may move between the table capture and the msync below, or the table
+    // would point at an extent that holds another block by then
+    std::lock_guard<std::mutex> relocationLock(relocationMutex);
+    
+    // Extents freed before the capture are not in the new table. Those freed later
+    // stay held back, the new table still has their blocks
+    std::vector<std::pair<size_t, size_t>> freed;
+    {
+        std::lock_guard<std::mutex> allocatorLock(allocatorMutex);
+        freed.swap(quarantinedExtents);
     }
     
-    // Setup server address
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(port);
+    uint64_t changes = changeCount;
+    std::vector<char> unused;
+    Snapshot table = takeSnapshot(false, unused);
     
-    // Bind socket
-    if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-        std::cerr << "Error binding socket to port " << port << std::endl;
-        close(serverSocket);
-        return;
+    // Pool first: the table on disk must never point at data that isn't there yet
+    bool saved = msync(memoryPool, poolSize, MS_SYNC) == 0;
+    if (!saved) {
+        std::cerr << "Failed to sync pool file: " << strerror(errno) << std::endl;
+    } else {
+        saved = table.save(tableFilePath(), nullptr);
     }
     
-    // Listen for connections
-    if (listen(serverSocket, 5) < 0) {
-        std::cerr << "Error listening on socket" << std::endl;
-        close(serverSocket);
-        return;
+    // The old table is still the one on disk if anything failed
+    std::lock_guard<std::mutex> allocatorLock(allocatorMutex);
+    if (!saved) {
+        quarantinedExtents.insert(quarantinedExtents.end(), freed.begin(), freed.end());
+        return false;
+    }
+    for (const auto& [offset, size] : freed) {
+        allocator.release(offset, size);
     }
     
-    std::cout << "Memory Manager listening on port " << port << std::endl;
-    
-    // Message struct definition (must match the one in MPointer.h)
-    struct Message {
-        uint8_t type;  // MessageType enum
-        int id;
-        size_t size;
-        char typeStr[32];
-        char data[1024];
-    };
-    
-    // Accept and handle connections
+    checkpointedChanges = changes;
+    return true;
+}
+
+void MemoryManager::checkpointer() {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
     while (running) {
-        // Accept a connection (with timeout to check running flag)
-        fd_set readSet;
-        FD_ZERO(&readSet);
-        FD_SET(serverSocket, &readSet);
-        
-        struct timeval timeout;
-        timeout.tv_sec = 1;  // 1 second timeout
-        timeout.tv_usec = 0;
-        
-        int ready = select(serverSocket + 1, &readSet, nullptr, nullptr, &timeout);
-        
-        if (ready <= 0) {
-            // Timeout or error, check if we should continue running
-            continue;
-        }
-        
-        clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
-        if (clientSocket < 0) {
-            std::cerr << "Error accepting connection" << std::endl;
-            continue;
+        checkpointCondition.wait_for(lock, std::chrono::milliseconds(options.checkpointIntervalMs),
+                                     [this] { return !running; });
+        if (!running) {
+            break;
         }
         
-        std::cout << "Connection accepted from " << inet_ntoa(clientAddr.sin_addr) << ":" << ntohs(clientAddr.sin_port) << std::endl;
-        
-        // Handle the client
-        Message request, response;
-        
-        // Receive message
-        ssize_t bytesRead = recv(clientSocket, &request, sizeof(Message), 0);
-        if (bytesRead != sizeof(Message)) {
-            std::cerr << "Error reading message" << std::endl;
-            close(clientSocket);
+        // Nothing to write when nothing changed
+        if (changeCount == checkpointedChanges) {
             continue;
         }
         
-        // Process message
-        std::cout << "Received message type: " << (int)request.type << std::endl;
-        
-        // Initialize response
-        memset(&response, 0, sizeof(Message));
-        response.type = request.type;
-        response.id = request.id;
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
+}
+
+bool MemoryManager::recoverFromLog() {
+    if (std::filesystem::exists(logCheckpointPath()) && !loadSnapshot(logCheckpointPath())) {
+        return false;
+    }
+    
+    size_t replayed = 0;
+    bool applied = WriteAheadLog::replay(dumpFolder, [&](const WriteAheadLog::Record& record) {
+        replayed++;
+        return replayRecord(record);
+    });
+    if (!applied) {
+        return false;
+    }
+    
+    if (replayed > 0) {
+        std::cout << "Replayed " << replayed << " log records, " << countBlocks() << " blocks recovered" << std::endl;
         
-        // Process based on message type
-        switch (request.type) {
-            case 1:  // CREATE
-                response.id = create(request.size, request.typeStr);
-                std::cout << "Created block with ID: " << response.id << std::endl;
-                break;
-                
-            case 2:  // SET
-                if (set(request.id, request.data, request.size)) {
-                    std::cout << "Set value for ID: " << request.id << std::endl;
-                } else {
-                    std::cerr << "Failed to set value for ID: " << request.id << std::endl;
-                    response.id = -1;
-                }
-                break;
-                
-            case 3:  // GET
-                if (get(request.id, response.data, request.size)) {
-                    std::cout << "Got value for ID: " << request.id << std::endl;
-                } else {
-                    std::cerr << "Failed to get value for ID: " << request.id << std::endl;
-                    response.id = -1;
-                }
-                break;
-                
-            case 4:  // INCREASE_REF_COUNT
-                if (increaseRefCount(request.id)) {
-                    std::cout << "Increased ref count for ID: " << request.id << std::endl;
-                } else {
-                    std::cerr << "Failed to increase ref count for ID: " << request.id << std::endl;
-                    response.id = -1;
-                }
-                break;
-                
-            case 5:  // DECREASE_REF_COUNT
-                if (decreaseRefCount(request.id)) {
-                    std::cout << "Decreased ref count for ID: " << request.id << std::endl;
-                } else {
-                    std::cerr << "Failed to decrease ref count for ID: " << request.id << std::endl;
-                    response.id = -1;
+        // Blocks that were waiting for the garbage collector
+        rebuildFreeSlots();
+        for (size_t shardIndex = 0; shardIndex < shards.size(); shardIndex++) {
+            BlockShard& shard = shards[shardIndex];
+            for (uint32_t index = 0; index < shard.slotCount; index++) {
+                const MemoryBlock& block = shard.slot(index);
+                if (block.used && block.refCount <= 0) {
+                    reclaimQueue.push_back(blockId(shardIndex, index, block.generation));
                 }
-                break;
-                
-            default:
-                std::cerr << "Unknown message type: " << (int)request.type << std::endl;
-                response.id = -1;
-                break;
+            }
         }
         
-        // Send response
-        send(clientSocket, &response, sizeof(Message), 0);
-        
-        // Close client socket
-        close(clientSocket);
+        // The replayed state becomes the new checkpoint, open() then discards the old segments
+        std::vector<char> contents;
+        Snapshot snapshot = takeSnapshot(true, contents);
+        return snapshot.save(logCheckpointPath(), contents.data());
     }
-    
-    // Close server socket
-    close(serverSocket);
+    return true;
 }
 
-void MemoryManager::garbageCollector() {
-    while (running) {
-        {
-            std::lock_guard<std::mutex> lock(blocksMutex);
+bool MemoryManager::replayRecord(const WriteAheadLog::Record& record) {
+    // Records may be replayed on a checkpoint that already contains them, so every
+    // record must be harmless to apply twice. Only runs at startup, before any other
+    // thread exists, so nothing is locked
+    BlockShard& shard = shardFor(record.id);
+    MemoryBlock* block = findBlock(shard, record.id);
+    switch (record.type) {
+        case WriteAheadLog::RecordType::CREATE: {
+            // The slot may hold this block already, or a later one
+            block = placeBlock(record.id);
+            if (!block) {
+                return true;
+            }
+            size_t offset = allocator.allocate(record.size);
+            if (offset == PoolAllocator::NO_SPACE) {
+                std::cerr << "No space to replay block " << record.id << std::endl;
+                return false;
+            }
+            block->offset = offset;
+            block->size = record.size;
+            block->typeId = internType(record.blockType);
+            shard.blocksByOffset[offset] = record.id;
+            break;
+        }
             
-            // Find and free blocks with zero references
-            for (auto it = blocks.begin(); it != blocks.end(); ++it) {
-                if (it->second.inUse && it->second.refCount <= 0) {
-                    std::cout << "Garbage collector freeing block " << it->first << std::endl;
-                    it->second.inUse = false;
-                }
+        case WriteAheadLog::RecordType::SET:
+            if (block) {
+                std::memcpy(static_cast<char*>(memoryPool) + block->offset, record.data,
+                            std::min<size_t>(record.size, block->size));
+                block->version = ++versionClock;
+            }
+            break;
+            
+        case WriteAheadLog::RecordType::SET_RANGE:
+            if (block && record.offset < block->size) {
+                std::memcpy(static_cast<char*>(memoryPool) + block->offset + record.offset, record.data,
+                            std::min<size_t>(record.size, block->size - record.offset));
+                block->version = ++versionClock;
+            }
+            break;
+            
+        case WriteAheadLog::RecordType::REF_COUNT:
+            if (block) {
+                block->refCount = record.refCount;
+            }
+            break;
+            
+        case WriteAheadLog::RecordType::FREE:
+            if (block) {
+                allocator.release(block->offset, block->size);
+                shard.blocksByOffset.erase(block->offset);
+                shard.slot(((static_cast<uint32_t>(record.id) & SLOT_MASK) - 1) / shards.size()).used = false;
             }
+            break;
+    }
+    return true;
+}
+
+bool MemoryManager::checkpointLog() {
+    uint64_t closedSegment = 0;
+    std::vector<char> contents;
+    Snapshot snapshot = takeSnapshot(true, contents, &closedSegment);
+    if (closedSegment == 0 || !snapshot.save(logCheckpointPath(), contents.data())) {
+        std::cerr << "Failed to checkpoint the write-ahead log" << std::endl;
+        return false;
+    }
+    
+    wal->discardUpTo(closedSegment);
+    return true;
+}
+
+void MemoryManager::logCheckpointer() {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    while (running) {
+        checkpointCondition.wait_for(lock, std::chrono::milliseconds(options.logCheckpointIntervalMs),
+                                     [this] { return !running; });
+        if (!running) {
+            break;
         }
         
-        // Sleep for a while
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        // Nothing to truncate when nothing was logged
+        if (!wal->hasNewRecords()) {
+            continue;
+        }
+        
+        lock.unlock();
+        checkpointLog();
+        lock.lock();
+    }
+}
+
+void MemoryManager::commitLog() {
+    if (wal && loggedLsn > 0) {
+        wal->commit(loggedLsn);
+        loggedLsn = 0;
     }
 }
 
 void MemoryManager::createMemoryDump() {
+    // Copy the block table so the file is written without holding the lock
+    std::vector<char> unused;
+    Snapshot snapshot = takeSnapshot(false, unused);
+    pendingMutations = 0;
+    
     // Create timestamp for filename
     auto now = std::chrono::system_clock::now();
     auto now_time_t = std::chrono::system_clock::to_time_t(now);
@@ -360,79 +2033,37 @@ void MemoryManager::createMemoryDump() {
         return;
     }
     
-    // Write header
-    dumpFile << "Memory Dump - " << std::put_time(std::localtime(&now_time_t), "%Y-%m-%d %H:%M:%S") 
-             << "." << std::setfill('0') << std::setw(3) << now_ms.count() << std::endl;
-    dumpFile << "Total Memory: " << poolSize << " bytes" << std::endl;
-    dumpFile << "----------------------------------------" << std::endl;
-    
-    // Write block information
-    dumpFile << "Blocks:" << std::endl;
-    for (const auto& pair : blocks) {
-        const auto& id = pair.first;
-        const auto& block = pair.second;
-        
-        dumpFile << "ID: " << id 
-                 << ", Offset: " << block.offset 
-                 << ", Size: " << block.size 
-                 << ", Type: " << block.type 
-                 << ", RefCount: " << block.refCount 
-                 << ", InUse: " << (block.inUse ? "Yes" : "No") << std::endl;
-    }
-    
+    snapshot.writeText(dumpFile);
     dumpFile.close();
 }
 
-size_t MemoryManager::findFreeSpace(size_t size) {
-    // Simple first-fit algorithm
-    std::vector<std::pair<size_t, size_t>> usedRanges;
-    
-    // Collect all used memory ranges
-    for (const auto& pair : blocks) {
-        if (pair.second.inUse) {
-            usedRanges.emplace_back(pair.second.offset, pair.second.offset + pair.second.size);
-        }
-    }
-    
-    // Sort by offset
-    std::sort(usedRanges.begin(), usedRanges.end());
-    
-    // Check for gaps
-    size_t currentOffset = 0;
-    for (const auto& range : usedRanges) {
-        if (range.first - currentOffset >= size) {
-            return currentOffset;
-        }
-        currentOffset = std::max(currentOffset, range.second);
-    }
-    
-    // Check if there's space at the end
-    if (poolSize - currentOffset >= size) {
-        return currentOffset;
-    }
-    
-    return std::numeric_limits<size_t>::max();  // No space found
-}
-
 void MemoryManager::defragmentMemory() {
     std::cout << "Defragmenting memory..." << std::endl;
     
-    // Collect all active blocks
+    // Collect all active blocks (every shard and the allocator are locked, the
+    // shard free lists are empty)
     std::vector<std::pair<int, MemoryBlock*>> activeBlocks;
-    for (auto& pair : blocks) {
-        if (pair.second.inUse) {
-            activeBlocks.emplace_back(pair.first, &pair.second);
+    for (size_t shardIndex = 0; shardIndex < shards.size(); shardIndex++) {
+        BlockShard& shard = shards[shardIndex];
+        for (uint32_t index = 0; index < shard.slotCount; index++) {
+            MemoryBlock& block = shard.slot(index);
+            if (block.used) {
+                activeBlocks.emplace_back(blockId(shardIndex, index, block.generation), &block);
+            }
         }
+        shard.blocksByOffset.clear();
     }
     
     // Sort by offset
     std::sort(activeBlocks.begin(), activeBlocks.end(), 
               [](const auto& a, const auto& b) { return a.second->offset < b.second->offset; });
     
-    // Compact memory
+    // Compact memory (pinned blocks are being streamed and stay where they are)
     size_t currentOffset = 0;
     for (auto& [id, block] : activeBlocks) {
-        if (block->offset != currentOffset) {
+        if (block->pinCount > 0) {
+            currentOffset = std::max(currentOffset, block->offset);
+        } else if (block->offset != currentOffset) {
             // Move data
             char* src = static_cast<char*>(memoryPool) + block->offset;
             char* dest = static_cast<char*>(memoryPool) + currentOffset;
@@ -441,8 +2072,162 @@ void MemoryManager::defragmentMemory() {
             // Update offset
             block->offset = currentOffset;
         }
-        currentOffset += block->size;
+        currentOffset = block->offset + PoolAllocator::roundUp(block->size);
+    }
+    
+    // Everything after the compacted blocks is free again
+    std::vector<std::pair<size_t, size_t>> usedExtents;
+    for (auto& [id, block] : activeBlocks) {
+        usedExtents.emplace_back(block->offset, block->size);
+        shardFor(id).blocksByOffset[block->offset] = id;
+    }
+    allocator.rebuild(usedExtents);
+    
+    std::cout << "Defragmentation complete. Free space: " << allocator.getFreeBytes() << " bytes" << std::endl;
+}
+
+CompactionStats MemoryManager::getCompactionStats() {
+    std::lock_guard<std::mutex> lock(compactorMutex);
+    return lastCompaction;
+}
+
+double MemoryManager::fragmentationPercent() const {
+    size_t freeBytes = allocator.getFreeBytes() + shardCachedBytes;
+    if (freeBytes == 0) {
+        return 0.0;
+    }
+    return 100.0 * (1.0 - static_cast<double>(allocator.getLargestFreeExtent()) / freeBytes);
+}
+
+void MemoryManager::compactor() {
+    std::unique_lock<std::mutex> lock(compactorMutex);
+    while (running) {
+        compactorCondition.wait_for(lock, std::chrono::milliseconds(options.compactionIntervalMs),
+                                    [this] { return !running; });
+        if (!running) {
+            break;
+        }
+        
+        lock.unlock();
+        CompactionStats stats = compactionStep();
+        lock.lock();
+        lastCompaction = stats;
+        
+        if (stats.blocksMoved > 0) {
+            std::cout << "Compaction step: fragmentation " << std::fixed << std::setprecision(1)
+                      << stats.fragmentationPercent << "%, moved " << stats.blocksMoved
+                      << " blocks (" << stats.bytesMoved << " bytes)" << std::endl;
+        }
+    }
+}
+
+CompactionStats MemoryManager::compactionStep() {
+    CompactionStats stats;
+    
+    // Pick the blocks whose move frees the most contiguous space per byte copied:
+    // a block that sits right after a hole merges that hole with whatever follows it
+    struct Candidate {
+        int id;
+        size_t offset;
+        double benefit;
+    };
+    std::vector<Candidate> candidates;
+    {
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+        if (fragmentationPercent() < options.compactionThreshold) {
+            return stats;
+        }
+        
+        // A mapped pool waits for the checkpoint that releases what the last moves vacated
+        if (poolFd != -1 && !quarantinedExtents.empty()) {
+            return stats;
+        }
+    }
+    {
+        auto locks = lockAllShards();
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+        
+        // Merge the parked small blocks first, they may be all the fragmentation there is
+        drainShardCaches();
+        allocator.coalesce();
+        stats.fragmentationPercent = fragmentationPercent();
+        if (stats.fragmentationPercent < options.compactionThreshold) {
+            return stats;
+        }
+        
+        const auto& freeExtents = allocator.getFreeExtents();
+        for (const auto& [holeOffset, holeSize] : freeExtents) {
+            // The block right after the hole, whichever shard it is in
+            const MemoryBlock* block = nullptr;
+            int id = -1;
+            for (auto& shard : shards) {
+                auto blockIt = shard.blocksByOffset.find(holeOffset + holeSize);
+                if (blockIt != shard.blocksByOffset.end()) {
+                    id = blockIt->second;
+                    block = findBlock(shard, id);
+                    break;
+                }
+            }
+            if (!block) {
+                continue;
+            }
+            
+            size_t blockSize = PoolAllocator::roundUp(block->size);
+            size_t end = block->offset + blockSize;
+            auto after = freeExtents.find(end);
+            size_t merged = holeSize + (after != freeExtents.end() ? after->second : 0);
+            candidates.push_back({id, block->offset, static_cast<double>(merged) / blockSize});
+        }
+    }
+    
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.benefit > b.benefit; });
+    
+    // Move blocks one at a time until the pause budget is used up. Requests to the
+    // block's shard only wait while it is being copied
+    auto start = std::chrono::steady_clock::now();
+    auto budget = std::chrono::microseconds(options.compactionPauseUs);
+    std::lock_guard<std::mutex> relocationLock(relocationMutex);
+    for (const auto& candidate : candidates) {
+        if (std::chrono::steady_clock::now() - start >= budget) {
+            break;
+        }
+        
+        BlockShard& shard = shardFor(candidate.id);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        
+        // The block may have been freed, moved or pinned in the meantime
+        MemoryBlock* found = findBlock(shard, candidate.id);
+        if (!found || found->pinCount > 0 || found->offset != candidate.offset) {
+            continue;
+        }
+        MemoryBlock& block = *found;
+        
+        size_t target;
+        {
+            std::lock_guard<std::mutex> allocatorLock(allocatorMutex);
+            target = allocator.allocateBelow(block.size, block.offset);
+        }
+        if (target == PoolAllocator::NO_SPACE) {
+            continue;
+        }
+        
+        // Only this shard waits for the copy
+        char* base = static_cast<char*>(memoryPool);
+        std::memcpy(base + target, base + block.offset, block.size);
+        
+        {
+            std::lock_guard<std::mutex> allocatorLock(allocatorMutex);
+            freeExtent(block.offset, block.size);
+        }
+        shard.blocksByOffset.erase(block.offset);
+        block.offset = target;
+        shard.blocksByOffset[target] = candidate.id;
+        changeCount++;
+        
+        stats.blocksMoved++;
+        stats.bytesMoved += block.size;
     }
     
-    std::cout << "Defragmentation complete. Free space: " << (poolSize - currentOffset) << " bytes" << std::endl;
-}
\ No newline at end of file
+    return stats;
+}
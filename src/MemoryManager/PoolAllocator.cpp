@@ -0,0 +1,170 @@
+#include "../../include/PoolAllocator.h"
+#include <algorithm>
+
+PoolAllocator::PoolAllocator(size_t poolSize)
+    : poolSize(poolSize), freeBytes(0), cachedBytes(0), sizeClasses(SMALL_LIMIT / ALIGNMENT) {
+    rebuild({});
+}
+
+size_t PoolAllocator::roundUp(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t PoolAllocator::allocate(size_t size) {
+    size_t rounded = roundUp(size);
+    if (rounded < size) {
+        return NO_SPACE;  // Overflow
+    }
+
+    // Small blocks: reuse a freed block of the same class
+    if (rounded <= SMALL_LIMIT) {
+        auto& freeList = sizeClasses[rounded / ALIGNMENT - 1];
+        if (!freeList.empty()) {
+            size_t offset = freeList.back();
+            freeList.pop_back();
+            cachedBytes -= rounded;
+            freeBytes -= rounded;
+            return offset;
+        }
+    }
+
+    size_t offset = allocateExtent(rounded);
+    if (offset == NO_SPACE && cachedBytes > 0) {
+        // Give the parked small blocks back to the tree so they can coalesce
+        coalesce();
+        offset = allocateExtent(rounded);
+    }
+    return offset;
+}
+
+size_t PoolAllocator::allocateBelow(size_t size, size_t limit) {
+    size_t rounded = roundUp(size);
+
+    // First fit in address order
+    for (auto it = extentsByOffset.begin(); it != extentsByOffset.end() && it->first + rounded <= limit; ++it) {
+        if (it->second < rounded) {
+            continue;
+        }
+
+        size_t offset = it->first;
+        size_t extentSize = it->second;
+        eraseExtent(it);
+        if (extentSize > rounded) {
+            extentsByOffset.emplace(offset + rounded, extentSize - rounded);
+            extentsBySize.emplace(extentSize - rounded, offset + rounded);
+        }
+        freeBytes -= rounded;
+        return offset;
+    }
+    return NO_SPACE;
+}
+
+void PoolAllocator::release(size_t offset, size_t size) {
+    size_t rounded = roundUp(size);
+    freeBytes += rounded;
+
+    if (rounded <= SMALL_LIMIT) {
+        sizeClasses[rounded / ALIGNMENT - 1].push_back(offset);
+        cachedBytes += rounded;
+        return;
+    }
+
+    insertExtent(offset, rounded);
+}
+
+void PoolAllocator::rebuild(const std::vector<std::pair<size_t, size_t>>& usedExtents) {
+    for (auto& freeList : sizeClasses) {
+        freeList.clear();
+    }
+    extentsByOffset.clear();
+    extentsBySize.clear();
+    cachedBytes = 0;
+    freeBytes = 0;
+
+    std::vector<std::pair<size_t, size_t>> used(usedExtents);
+    std::sort(used.begin(), used.end());
+
+    // Every gap between used extents is free
+    size_t currentOffset = 0;
+    for (const auto& extent : used) {
+        if (extent.first > currentOffset) {
+            insertExtent(currentOffset, extent.first - currentOffset);
+            freeBytes += extent.first - currentOffset;
+        }
+        currentOffset = std::max(currentOffset, extent.first + roundUp(extent.second));
+    }
+    if (currentOffset < poolSize) {
+        insertExtent(currentOffset, poolSize - currentOffset);
+        freeBytes += poolSize - currentOffset;
+    }
+}
+
+size_t PoolAllocator::getLargestFreeExtent() const {
+    if (extentsBySize.empty()) {
+        return 0;
+    }
+    return extentsBySize.rbegin()->first;
+}
+
+size_t PoolAllocator::allocateExtent(size_t size) {
+    // Best fit: the smallest extent that is large enough
+    auto best = extentsBySize.lower_bound({size, 0});
+    if (best == extentsBySize.end()) {
+        return NO_SPACE;
+    }
+
+    size_t offset = best->second;
+    size_t extentSize = best->first;
+    eraseExtent(extentsByOffset.find(offset));
+
+    // Keep the remainder free
+    if (extentSize > size) {
+        extentsByOffset.emplace(offset + size, extentSize - size);
+        extentsBySize.emplace(extentSize - size, offset + size);
+    }
+
+    freeBytes -= size;
+    return offset;
+}
+
+void PoolAllocator::insertExtent(size_t offset, size_t size) {
+    // Coalesce with the free extent right after this one
+    auto next = extentsByOffset.lower_bound(offset);
+    if (next != extentsByOffset.end() && offset + size == next->first) {
+        size += next->second;
+        next = std::next(next);
+        eraseExtent(std::prev(next));
+    }
+
+    // ... and with the one right before it
+    if (next != extentsByOffset.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            eraseExtent(previous);
+        }
+    }
+
+    extentsByOffset.emplace(offset, size);
+    extentsBySize.emplace(size, offset);
+}
+
+void PoolAllocator::eraseExtent(std::map<size_t, size_t>::iterator it) {
+    extentsBySize.erase({it->second, it->first});
+    extentsByOffset.erase(it);
+}
+
+void PoolAllocator::coalesce() {
+    for (size_t i = 0; i < sizeClasses.size(); i++) {
+        size_t size = (i + 1) * ALIGNMENT;
+        for (size_t offset : sizeClasses[i]) {
+            insertExtent(offset, size);
+        }
+        sizeClasses[i].clear();
+    }
+    cachedBytes = 0;
+}
@@ -0,0 +1,187 @@
+#include "../../include/Snapshot.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = {'M', 'P', 'S', 'N', 'A', 'P', '0', '1'};
+const size_t HEADER_SIZE = 8 + 4 + 4 + 8 + 8 + 4 + 4 + 8;
+const uint32_t FLAG_POOL_CONTENTS = 0x1;
+
+void putLE(std::vector<char>& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint64_t getLE(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+bool Snapshot::save(const std::string& path, const char* pool) const {
+    // Header and block table go in one buffer
+    std::vector<char> table;
+    table.reserve(HEADER_SIZE + blocks.size() * 40);
+    table.insert(table.end(), MAGIC, MAGIC + sizeof(MAGIC));
+    putLE(table, VERSION, 4);
+    putLE(table, pool ? FLAG_POOL_CONTENTS : 0, 4);
+    putLE(table, poolSize, 8);
+    putLE(table, pool ? poolBytes : 0, 8);
+    putLE(table, static_cast<uint32_t>(nextId), 4);
+    putLE(table, blocks.size(), 4);
+    putLE(table, timestamp, 8);
+
+    for (const auto& block : blocks) {
+        putLE(table, static_cast<uint32_t>(block.id), 4);
+        putLE(table, block.offset, 8);
+        putLE(table, block.size, 8);
+        putLE(table, static_cast<uint32_t>(block.refCount), 4);
+        size_t typeLength = std::min<size_t>(block.type.size(), UINT16_MAX);
+        putLE(table, typeLength, 2);
+        table.insert(table.end(), block.type.begin(), block.type.begin() + typeLength);
+    }
+
+    // Write to a temporary file and rename it, so a crash never leaves a half-written snapshot
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to create snapshot file: " << tempPath << std::endl;
+            return false;
+        }
+
+        file.write(table.data(), table.size());
+        if (pool && poolBytes > 0) {
+            file.write(pool, poolBytes);
+        }
+
+        file.flush();
+        if (!file) {
+            std::cerr << "Failed to write snapshot file: " << tempPath << std::endl;
+            return false;
+        }
+    }
+
+    // Make sure the data is on disk before the rename makes it the current snapshot
+    int fd = open(tempPath.c_str(), O_RDONLY);
+    if (fd == -1 || fsync(fd) != 0) {
+        std::cerr << "Failed to sync snapshot file: " << tempPath << std::endl;
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to rename snapshot file to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Snapshot::load(const std::string& path, char* pool, size_t poolCapacity) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open snapshot file: " << path << std::endl;
+        return false;
+    }
+
+    char header[HEADER_SIZE];
+    if (!file.read(header, HEADER_SIZE) || std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << "Not a snapshot file: " << path << std::endl;
+        return false;
+    }
+
+    uint32_t version = static_cast<uint32_t>(getLE(header + 8, 4));
+    if (version != VERSION) {
+        std::cerr << "Unsupported snapshot version " << version << std::endl;
+        return false;
+    }
+
+    uint32_t flags = static_cast<uint32_t>(getLE(header + 12, 4));
+    poolSize = getLE(header + 16, 8);
+    poolBytes = getLE(header + 24, 8);
+    nextId = static_cast<int>(getLE(header + 32, 4));
+    size_t blockCount = getLE(header + 36, 4);
+    timestamp = getLE(header + 40, 8);
+
+    blocks.clear();
+    blocks.reserve(blockCount);
+    char entry[26];
+    for (size_t i = 0; i < blockCount; i++) {
+        if (!file.read(entry, sizeof(entry))) {
+            std::cerr << "Truncated snapshot block table" << std::endl;
+            return false;
+        }
+
+        SnapshotBlock block;
+        block.id = static_cast<int>(getLE(entry, 4));
+        block.offset = getLE(entry + 4, 8);
+        block.size = getLE(entry + 12, 8);
+        block.refCount = static_cast<int>(getLE(entry + 20, 4));
+        block.type.resize(getLE(entry + 24, 2));
+        if (!file.read(&block.type[0], block.type.size())) {
+            std::cerr << "Truncated snapshot block table" << std::endl;
+            return false;
+        }
+        blocks.push_back(std::move(block));
+    }
+
+    if (!pool) {
+        return true;
+    }
+
+    // A table-only snapshot can't restore blocks (an empty one has nothing to restore)
+    if (!(flags & FLAG_POOL_CONTENTS) && !blocks.empty()) {
+        std::cerr << "Snapshot has no pool contents" << std::endl;
+        return false;
+    }
+
+    if (poolBytes > poolCapacity) {
+        std::cerr << "Snapshot needs " << poolBytes << " bytes of pool, only " << poolCapacity << " available" << std::endl;
+        return false;
+    }
+
+    if (!file.read(pool, poolBytes)) {
+        std::cerr << "Truncated snapshot pool contents" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Snapshot::writeText(std::ostream& out) const {
+    auto time = std::chrono::system_clock::time_point(std::chrono::milliseconds(timestamp));
+    auto time_t = std::chrono::system_clock::to_time_t(time);
+
+    // Write header
+    out << "Memory Dump - " << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S")
+        << "." << std::setfill('0') << std::setw(3) << (timestamp % 1000) << std::endl;
+    out << "Total Memory: " << poolSize << " bytes" << std::endl;
+    out << "----------------------------------------" << std::endl;
+
+    // Write block information
+    out << "Blocks:" << std::endl;
+    for (const auto& block : blocks) {
+        out << "ID: " << block.id
+            << ", Offset: " << block.offset
+            << ", Size: " << block.size
+            << ", Type: " << block.type
+            << ", RefCount: " << block.refCount
+            << ", InUse: " << (block.refCount > 0 ? "Yes" : "No") << "\n";
+    }
+}
@@ -0,0 +1,377 @@
+#include "../../include/WriteAheadLog.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t RECORD_HEADER_SIZE = 8;   // u32 body length, u32 checksum
+const size_t BODY_HEADER_SIZE = 5;     // u8 type, i32 id
+
+void putLE(std::vector<char>& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void setLE(char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+uint64_t getLE(const char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint32_t checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& folder, SyncPolicy policy)
+    : folder(folder), policy(policy), fd(-1), segment(0), appendedLsn(0), writtenLsn(0),
+      rotatedLsn(0), stopping(false), failed(false) {
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open() {
+    discardUpTo(UINT64_MAX);
+    segment = 0;
+    if (!openSegment()) {
+        return false;
+    }
+
+    stopping = false;
+    flusherThread = std::thread(&WriteAheadLog::flusher, this);
+    return true;
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    flushCondition.notify_all();
+
+    if (flusherThread.joinable()) {
+        flusherThread.join();
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+uint64_t WriteAheadLog::logCreate(int id, size_t size, const std::string& type) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t start = beginRecord(RecordType::CREATE, id);
+    size_t typeLength = std::min<size_t>(type.size(), UINT16_MAX);
+    putLE(buffer, size, 8);
+    putLE(buffer, typeLength, 2);
+    buffer.insert(buffer.end(), type.begin(), type.begin() + typeLength);
+    return endRecord(start);
+}
+
+uint64_t WriteAheadLog::logSet(int id, const char* value, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t start = beginRecord(RecordType::SET, id);
+    putLE(buffer, length, 8);
+    buffer.insert(buffer.end(), value, value + length);
+    return endRecord(start);
+}
+
+uint64_t WriteAheadLog::logSetRange(int id, size_t offset, const char* value, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t start = beginRecord(RecordType::SET_RANGE, id);
+    putLE(buffer, offset, 8);
+    putLE(buffer, length, 8);
+    buffer.insert(buffer.end(), value, value + length);
+    return endRecord(start);
+}
+
+uint64_t WriteAheadLog::logRefCount(int id, int refCount) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t start = beginRecord(RecordType::REF_COUNT, id);
+    putLE(buffer, static_cast<uint32_t>(refCount), 4);
+    return endRecord(start);
+}
+
+uint64_t WriteAheadLog::logFree(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return endRecord(beginRecord(RecordType::FREE, id));
+}
+
+size_t WriteAheadLog::beginRecord(RecordType type, int id) {
+    // The record header is filled in by endRecord, once the body length is known
+    size_t start = buffer.size();
+    buffer.resize(start + RECORD_HEADER_SIZE);
+    buffer.push_back(static_cast<char>(type));
+    putLE(buffer, static_cast<uint32_t>(id), 4);
+    return start;
+}
+
+uint64_t WriteAheadLog::endRecord(size_t start) {
+    const char* body = buffer.data() + start + RECORD_HEADER_SIZE;
+    size_t bodyLength = buffer.size() - start - RECORD_HEADER_SIZE;
+    setLE(buffer.data() + start, bodyLength, 4);
+    setLE(buffer.data() + start + 4, checksum(body, bodyLength), 4);
+
+    flushCondition.notify_one();
+    return ++appendedLsn;
+}
+
+void WriteAheadLog::commit(uint64_t lsn) {
+    if (policy != SyncPolicy::PER_OP) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    durableCondition.wait(lock, [&] { return writtenLsn >= lsn || failed || stopping; });
+}
+
+bool WriteAheadLog::hasNewRecords() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return appendedLsn != rotatedLsn;
+}
+
+void WriteAheadLog::flusher() {
+    std::vector<char> writing;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            flushCondition.wait(lock, [this] { return stopping || !buffer.empty(); });
+            if (stopping && buffer.empty()) {
+                break;
+            }
+        }
+
+        // Take everything appended so far, rotate() may have written it already
+        std::lock_guard<std::mutex> io(ioMutex);
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writing.swap(buffer);
+            lsn = appendedLsn;
+        }
+        if (!writing.empty()) {
+            writeOut(writing, lsn);
+            writing.clear();
+        }
+    }
+}
+
+bool WriteAheadLog::writeOut(const std::vector<char>& data, uint64_t lsn) {
+    bool written = fd != -1 && writeAll(fd, data.data(), data.size()) &&
+                   (policy == SyncPolicy::NONE || fdatasync(fd) == 0);
+    if (!written) {
+        std::cerr << "Failed to write the log: " << strerror(errno) << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (written) {
+            writtenLsn = lsn;
+        } else {
+            failed = true;
+        }
+    }
+    durableCondition.notify_all();
+    return written;
+}
+
+uint64_t WriteAheadLog::rotate() {
+    std::lock_guard<std::mutex> io(ioMutex);
+    std::vector<char> writing;
+    uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writing.swap(buffer);
+        lsn = appendedLsn;
+        rotatedLsn = appendedLsn;
+    }
+    if (!writing.empty() && !writeOut(writing, lsn)) {
+        return 0;
+    }
+
+    uint64_t closed = segment;
+    ::close(fd);
+    fd = -1;
+    return openSegment() ? closed : 0;
+}
+
+void WriteAheadLog::discardUpTo(uint64_t last) {
+    for (uint64_t number : listSegments(folder)) {
+        if (number <= last) {
+            std::filesystem::remove(segmentPath(folder, number));
+        }
+    }
+}
+
+bool WriteAheadLog::openSegment() {
+    segment++;
+    std::string path = segmentPath(folder, segment);
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to create log segment " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string WriteAheadLog::segmentPath(const std::string& folder, uint64_t segment) {
+    std::stringstream path;
+    path << folder << "/wal_" << std::setfill('0') << std::setw(6) << segment << ".log";
+    return path.str();
+}
+
+std::vector<uint64_t> WriteAheadLog::listSegments(const std::string& folder) {
+    std::vector<uint64_t> segments;
+    if (!std::filesystem::exists(folder)) {
+        return segments;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(folder)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 8 && name.compare(0, 4, "wal_") == 0 &&
+            name.compare(name.size() - 4, 4, ".log") == 0) {
+            segments.push_back(std::stoull(name.substr(4, name.size() - 8)));
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool WriteAheadLog::replay(const std::string& folder, const std::function<bool(const Record&)>& apply) {
+    for (uint64_t number : listSegments(folder)) {
+        std::string path = segmentPath(folder, number);
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        size_t position = 0;
+        while (position < data.size()) {
+            // A record cut short or with a bad checksum is the tail of an interrupted write
+            if (data.size() - position < RECORD_HEADER_SIZE) {
+                std::cerr << "Ignoring torn record at the end of " << path << std::endl;
+                break;
+            }
+            size_t bodyLength = getLE(data.data() + position, 4);
+            const char* body = data.data() + position + RECORD_HEADER_SIZE;
+            if (bodyLength < BODY_HEADER_SIZE || bodyLength > data.size() - position - RECORD_HEADER_SIZE ||
+                checksum(body, bodyLength) != getLE(data.data() + position + 4, 4)) {
+                std::cerr << "Ignoring torn record at the end of " << path << std::endl;
+                break;
+            }
+            position += RECORD_HEADER_SIZE + bodyLength;
+
+            Record record;
+            record.type = static_cast<RecordType>(body[0]);
+            record.id = static_cast<int>(getLE(body + 1, 4));
+            const char* fields = body + BODY_HEADER_SIZE;
+            size_t fieldsLength = bodyLength - BODY_HEADER_SIZE;
+
+            bool valid = true;
+            switch (record.type) {
+                case RecordType::CREATE:
+                    valid = fieldsLength >= 10 && fieldsLength == 10 + getLE(fields + 8, 2);
+                    if (valid) {
+                        record.size = getLE(fields, 8);
+                        record.blockType.assign(fields + 10, fieldsLength - 10);
+                    }
+                    break;
+                case RecordType::SET:
+                    valid = fieldsLength >= 8 && fieldsLength == 8 + getLE(fields, 8);
+                    if (valid) {
+                        record.size = fieldsLength - 8;
+                        record.data = fields + 8;
+                    }
+                    break;
+                case RecordType::SET_RANGE:
+                    valid = fieldsLength >= 16 && fieldsLength == 16 + getLE(fields + 8, 8);
+                    if (valid) {
+                        record.offset = getLE(fields, 8);
+                        record.size = fieldsLength - 16;
+                        record.data = fields + 16;
+                    }
+                    break;
+                case RecordType::REF_COUNT:
+                    valid = fieldsLength == 4;
+                    if (valid) {
+                        record.refCount = static_cast<int>(getLE(fields, 4));
+                    }
+                    break;
+                case RecordType::FREE:
+                    valid = fieldsLength == 0;
+                    break;
+                default:
+                    valid = false;
+                    break;
+            }
+
+            if (!valid) {
+                std::cerr << "Malformed record in " << path << std::endl;
+                return false;
+            }
+            if (!apply(record)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const char* WriteAheadLog::policyName(SyncPolicy policy) {
+    switch (policy) {
+        case SyncPolicy::NONE:
+            return "none";
+        case SyncPolicy::BATCH:
+            return "batch";
+        case SyncPolicy::PER_OP:
+            return "per-op";
+    }
+    return "unknown";
+}
+
+bool WriteAheadLog::parsePolicy(const std::string& name, SyncPolicy& policy) {
+    for (SyncPolicy candidate : {SyncPolicy::NONE, SyncPolicy::BATCH, SyncPolicy::PER_OP}) {
+        if (name == policyName(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
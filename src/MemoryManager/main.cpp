@@ -4,15 +4,91 @@
 #include <cstdlib>
 
 void printUsage(const char* programName) {
-    std::cout << "Usage: " << programName << " LISTEN_PORT SIZE_MB DUMP_FOLDER" << std::endl;
+    std::cout << "Usage: " << programName << " LISTEN_PORT SIZE_MB DUMP_FOLDER [OPTIONS]" << std::endl;
     std::cout << "  LISTEN_PORT: Port to listen for connections" << std::endl;
     std::cout << "  SIZE_MB: Size of memory pool in megabytes" << std::endl;
     std::cout << "  DUMP_FOLDER: Folder to store memory dumps" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --workers N: Number of threads serving requests (default: one per core)" << std::endl;
+    std::cout << "  --shards N: Partitions of the block table, each with its own lock (default: 16)" << std::endl;
+    std::cout << "  --verbose: Log every connection and request (slows the server down)" << std::endl;
+    std::cout << "  --compaction-interval-ms N: Time between background compaction steps, 0 disables it (default: 100)" << std::endl;
+    std::cout << "  --compaction-pause-us N: Time budget of one compaction step (default: 2000)" << std::endl;
+    std::cout << "  --compaction-threshold P: Fragmentation percentage that triggers compaction (default: 10)" << std::endl;
+    std::cout << "  --dump-interval-ms N: Write a memory dump at most every N ms if memory changed, 0 disables it (default: 1000)" << std::endl;
+    std::cout << "  --dump-every N: Write a memory dump after every N changes, 0 disables it (default: 0)" << std::endl;
+    std::cout << "  --snapshot FILE: Binary snapshot loaded at startup (if it exists) and saved on shutdown" << std::endl;
+    std::cout << "  --mapped-pool: Keep the pool in DUMP_FOLDER/pool.bin (memory-mapped) and reuse it on restart" << std::endl;
+    std::cout << "  --populate: Load the whole pool file into memory at startup (with --mapped-pool)" << std::endl;
+    std::cout << "  --huge-pages: Ask for transparent huge pages for the pool (with --mapped-pool)" << std::endl;
+    std::cout << "  --checkpoint-interval-ms N: Sync the mapped pool and its block table every N ms if memory changed, 0 = only on shutdown (default: 1000)" << std::endl;
+    std::cout << "  --wal POLICY: Log every change to DUMP_FOLDER and replay it at startup; POLICY is none, batch or per-op (when to fsync)" << std::endl;
+    std::cout << "  --wal-checkpoint-interval-ms N: Checkpoint and truncate the log every N ms, 0 = only on shutdown (default: 10000)" << std::endl;
+}
+
+// Parses the optional "--name value" and "--flag" arguments, returns false on an unknown option
+bool parseOptions(int argc, char* argv[], MemoryManagerOptions& options) {
+    for (int i = 4; i < argc; i++) {
+        std::string option = argv[i];
+        
+        // Flags take no value
+        if (option == "--mapped-pool") {
+            options.mappedPool = true;
+            continue;
+        } else if (option == "--populate") {
+            options.populatePool = true;
+            continue;
+        } else if (option == "--huge-pages") {
+            options.hugePages = true;
+            continue;
+        } else if (option == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+        
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for option " << option << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        
+        if (option == "--workers") {
+            options.workerThreads = std::stoul(value);
+        } else if (option == "--shards") {
+            options.blockShards = std::stoul(value);
+        } else if (option == "--compaction-interval-ms") {
+            options.compactionIntervalMs = std::stoul(value);
+        } else if (option == "--compaction-pause-us") {
+            options.compactionPauseUs = std::stoul(value);
+        } else if (option == "--compaction-threshold") {
+            options.compactionThreshold = std::stod(value);
+        } else if (option == "--dump-interval-ms") {
+            options.dumpIntervalMs = std::stoul(value);
+        } else if (option == "--dump-every") {
+            options.dumpEveryMutations = std::stoul(value);
+        } else if (option == "--snapshot") {
+            options.snapshotFile = value;
+        } else if (option == "--checkpoint-interval-ms") {
+            options.checkpointIntervalMs = std::stoul(value);
+        } else if (option == "--wal") {
+            if (!WriteAheadLog::parsePolicy(value, options.logSync)) {
+                std::cerr << "Unknown log sync policy " << value << std::endl;
+                return false;
+            }
+            options.writeAheadLog = true;
+        } else if (option == "--wal-checkpoint-interval-ms") {
+            options.logCheckpointIntervalMs = std::stoul(value);
+        } else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
     // Check command line arguments
-    if (argc != 4) {
+    if (argc < 4) {
         printUsage(argv[0]);
         return 1;
     }
@@ -23,8 +99,14 @@ int main(int argc, char* argv[]) {
         size_t sizeMB = std::stoll(argv[2]);
         std::string dumpFolder = argv[3];
         
+        MemoryManagerOptions options;
+        if (!parseOptions(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        
         // Create memory manager
-        MemoryManager memoryManager(port, sizeMB, dumpFolder);
+        MemoryManager memoryManager(port, sizeMB, dumpFolder, options);
         
         // Start server
         if (!memoryManager.startServer()) {
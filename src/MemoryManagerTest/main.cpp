@@ -0,0 +1,384 @@
+#include "../../include/MPointer.h"
+#include "../../include/PoolAllocator.h"
+#include "../../include/Snapshot.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <filesystem>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+const int TEST_PORT = 8090;
+const std::string TEST_FOLDER = "dump_files/memory_manager_test";
+std::string serverPath = "bin/MemoryManager";
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        throw std::runtime_error(what);
+    }
+}
+
+// Size of the free extent that starts at `offset`, 0 if there is none
+size_t extentAt(const PoolAllocator& allocator, size_t offset) {
+    auto it = allocator.getFreeExtents().find(offset);
+    return it != allocator.getFreeExtents().end() ? it->second : 0;
+}
+
+// A Memory Manager run as a child process. stop() presses Enter like an operator
+// would, crash() kills it without giving it a chance to save anything
+class ServerProcess {
+public:
+    ServerProcess(const std::string& folder, const std::vector<std::string>& options, int sizeMB = 10)
+        : folder(folder), options(options), sizeMB(sizeMB), pid(-1), input(-1) {}
+    
+    ~ServerProcess() {
+        if (pid > 0) {
+            crash();
+        }
+    }
+    
+    // Starts the server and waits until it accepts connections
+    void start() {
+        int fds[2];
+        check(pipe(fds) == 0, "Failed to create the server input pipe");
+        
+        pid = fork();
+        check(pid != -1, "Failed to start the Memory Manager");
+        if (pid == 0) {
+            dup2(fds[0], STDIN_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            int log = open((folder + ".log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (log != -1) {
+                dup2(log, STDOUT_FILENO);
+                dup2(log, STDERR_FILENO);
+                close(log);
+            }
+            
+            std::vector<std::string> args = {serverPath, std::to_string(TEST_PORT), std::to_string(sizeMB), folder};
+            args.insert(args.end(), options.begin(), options.end());
+            std::vector<char*> argv;
+            for (auto& arg : args) {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            execv(serverPath.c_str(), argv.data());
+            _exit(127);
+        }
+        close(fds[0]);
+        input = fds[1];
+        
+        for (int attempt = 0; attempt < 100; attempt++) {
+            check(waitpid(pid, nullptr, WNOHANG) == 0, "Memory Manager exited at startup, see " + folder + ".log");
+            if (accepting()) {
+                MemoryManagerClient::Init(TEST_PORT);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        throw std::runtime_error("Memory Manager did not start listening");
+    }
+    
+    // Clean shutdown
+    void stop() {
+        MemoryManagerClient::Cleanup();
+        check(write(input, "\n", 1) == 1, "Failed to stop the Memory Manager");
+        close(input);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+    
+    // Abrupt termination, as in a power failure
+    void crash() {
+        MemoryManagerClient::Cleanup();
+        kill(pid, SIGKILL);
+        close(input);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+
+private:
+    std::string folder;
+    std::vector<std::string> options;
+    int sizeMB;
+    pid_t pid;
+    int input;  // The server's standard input
+    
+    static bool accepting() {
+        int probe = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(TEST_PORT);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        bool connected = connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0;
+        close(probe);
+        return connected;
+    }
+};
+
+// Offset of every block of a snapshot file
+std::map<int, size_t> blockOffsets(const std::string& path) {
+    Snapshot snapshot;
+    check(snapshot.load(path, nullptr, 0), "Failed to read snapshot " + path);
+    std::map<int, size_t> offsets;
+    for (const auto& block : snapshot.blocks) {
+        offsets[block.id] = block.offset;
+    }
+    return offsets;
+}
+
+// Blocks written before a restart, checked after it
+struct RestartData {
+    std::vector<int> values;  // Blocks holding an int, i * 7
+    int large = -1;           // 256 KB of (i % 251), with "restart" written at offset 1000
+    int freed = -1;           // Released before the restart
+};
+
+const size_t LARGE_SIZE = 256 * 1024;
+const size_t PATCH_OFFSET = 1000;
+const std::string PATCH = "restart";
+
+RestartData writeRestartData() {
+    RestartData data;
+    for (int i = 0; i < 50; i++) {
+        int id = MemoryManagerClient::Create(sizeof(int), "int");
+        int value = i * 7;
+        check(id != -1 && MemoryManagerClient::Set(id, &value, sizeof(value)), "Failed to write an int block");
+        data.values.push_back(id);
+    }
+    
+    std::vector<char> pattern(LARGE_SIZE);
+    for (size_t i = 0; i < LARGE_SIZE; i++) {
+        pattern[i] = static_cast<char>(i % 251);
+    }
+    data.large = MemoryManagerClient::Create(LARGE_SIZE, "bytes");
+    check(data.large != -1 && MemoryManagerClient::Set(data.large, pattern.data(), LARGE_SIZE) &&
+          MemoryManagerClient::SetRange(data.large, PATCH_OFFSET, PATCH.data(), PATCH.size()),
+          "Failed to write the large block");
+    
+    data.freed = MemoryManagerClient::Create(sizeof(int), "int");
+    check(data.freed != -1 && MemoryManagerClient::DecreaseRefCount(data.freed), "Failed to free a block");
+    return data;
+}
+
+// Reads everything back and releases it
+void checkRestartData(const RestartData& data) {
+    for (size_t i = 0; i < data.values.size(); i++) {
+        int value = -1;
+        check(MemoryManagerClient::Get(data.values[i], &value, sizeof(value)) && value == static_cast<int>(i) * 7,
+              "An int block was not restored");
+        MemoryManagerClient::DecreaseRefCount(data.values[i]);
+    }
+    
+    std::vector<char> contents(LARGE_SIZE);
+    check(MemoryManagerClient::GetRange(data.large, 0, contents.data(), LARGE_SIZE), "The large block was not restored");
+    for (size_t i = 0; i < LARGE_SIZE; i++) {
+        bool patched = i >= PATCH_OFFSET && i < PATCH_OFFSET + PATCH.size();
+        char expected = patched ? PATCH[i - PATCH_OFFSET] : static_cast<char>(i % 251);
+        check(contents[i] == expected, "The large block was restored with the wrong contents");
+    }
+    MemoryManagerClient::DecreaseRefCount(data.large);
+    
+    check(!MemoryManagerClient::IncreaseRefCount(data.freed), "A freed block came back after the restart");
+}
+
+// Test the server side of the Memory Manager. Servers are started on TEST_PORT with
+// their files in TEST_FOLDER, the path of the MemoryManager binary can be passed as
+// the first argument
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        serverPath = argv[1];
+    }
+    
+    try {
+        std::filesystem::remove_all(TEST_FOLDER);
+        std::filesystem::create_directories(TEST_FOLDER);
+        
+        std::cout << "\n=== TEST 1: ALLOCATOR ===\n";
+        {
+            const size_t poolSize = 64 * 1024;
+            PoolAllocator allocator(poolSize);
+            
+            size_t a = allocator.allocate(4096);
+            size_t b = allocator.allocate(8192);
+            size_t c = allocator.allocate(4096);
+            size_t d = allocator.allocate(2048);
+            check(a == 0 && b == 4096 && c == 12288 && d == 16384, "Blocks were not carved from the start of the pool");
+            
+            // Fit: the 8 KB hole is the smallest extent that holds 5000 bytes
+            allocator.release(b, 8192);
+            size_t e = allocator.allocate(5000);
+            check(e == b, "Allocation did not take the best fitting extent");
+            
+            // Split: what the block doesn't use stays free right after it
+            size_t used = PoolAllocator::roundUp(5000);
+            check(extentAt(allocator, e + used) == 8192 - used, "The rest of the split extent was lost");
+            
+            // Small blocks come back from their size class
+            size_t small = allocator.allocate(100);
+            allocator.release(small, 100);
+            check(allocator.allocate(100) == small, "A freed small block was not reused");
+            allocator.release(small, 100);
+            allocator.coalesce();
+            
+            // Merge: freed neighbours become one extent again
+            allocator.release(e, 5000);
+            check(extentAt(allocator, b) == 8192, "Freed extent was not merged with the rest of its hole");
+            allocator.release(c, 4096);
+            check(extentAt(allocator, b) == 12288, "Freed extent was not merged with the one before it");
+            allocator.release(d, 2048);
+            allocator.release(a, 4096);
+            check(allocator.getFreeExtents().size() == 1 && extentAt(allocator, 0) == poolSize,
+                  "The pool did not merge back into a single extent");
+            check(allocator.getFreeBytes() == poolSize, "Free bytes don't add up");
+            std::cout << "Fit, split and merge work" << std::endl;
+        }
+        
+        std::cout << "\n=== TEST 2: COMPACTION ===\n";
+        {
+            // A 1 MB pool almost filled with 64 KB blocks, every other one is freed
+            std::string snapshotPath = TEST_FOLDER + "/compaction.snap";
+            ServerProcess server(TEST_FOLDER + "/compaction", {"--snapshot", snapshotPath}, 1);
+            server.start();
+            
+            const size_t blockSize = 64 * 1024;
+            std::vector<int> ids;
+            for (int i = 0; i < 15; i++) {
+                int id = MemoryManagerClient::Create(blockSize, "chunk");
+                check(id != -1, "Failed to fill the pool");
+                std::vector<char> value(blockSize, static_cast<char>('a' + i));
+                check(MemoryManagerClient::Set(id, value.data(), blockSize), "Failed to write a block");
+                ids.push_back(id);
+            }
+            check(MemoryManagerClient::RequestSnapshot(), "Failed to save a snapshot");
+            std::map<int, size_t> before = blockOffsets(snapshotPath);
+            
+            for (size_t i = 0; i < ids.size(); i += 2) {
+                check(MemoryManagerClient::DecreaseRefCount(ids[i]), "Failed to free a block");
+            }
+            
+            // The background compactor runs every 100 ms by default
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            check(MemoryManagerClient::RequestSnapshot(), "Failed to save a snapshot");
+            std::map<int, size_t> after = blockOffsets(snapshotPath);
+            
+            int moved = 0;
+            for (size_t i = 1; i < ids.size(); i += 2) {
+                check(after.count(ids[i]) == 1, "A live block disappeared");
+                moved += after[ids[i]] < before[ids[i]] ? 1 : 0;
+                
+                // GetRange is never served from the client cache
+                std::vector<char> value(blockSize);
+                check(MemoryManagerClient::GetRange(ids[i], 0, value.data(), blockSize), "Failed to read a block");
+                check(std::all_of(value.begin(), value.end(), [&](char c) { return c == 'a' + static_cast<int>(i); }),
+                      "A block lost its contents when it was moved");
+                MemoryManagerClient::DecreaseRefCount(ids[i]);
+            }
+            check(moved > 0, "Compaction did not move any block");
+            std::cout << moved << " blocks moved, their contents are intact" << std::endl;
+            
+            server.stop();
+        }
+        
+        std::cout << "\n=== TEST 3: SNAPSHOT RESTART ===\n";
+        {
+            // Saved on shutdown, loaded at startup
+            std::vector<std::string> options = {"--snapshot", TEST_FOLDER + "/restart.snap"};
+            ServerProcess server(TEST_FOLDER + "/snapshot", options);
+            server.start();
+            RestartData data = writeRestartData();
+            server.stop();
+            
+            ServerProcess restarted(TEST_FOLDER + "/snapshot", options);
+            restarted.start();
+            checkRestartData(data);
+            restarted.stop();
+            std::cout << "Blocks restored from the snapshot" << std::endl;
+        }
+        
+        std::cout << "\n=== TEST 4: MAPPED POOL RESTART ===\n";
+        {
+            // Killed once a checkpoint has run: the pool file and its table are all there is
+            std::vector<std::string> options = {"--mapped-pool", "--checkpoint-interval-ms", "100"};
+            ServerProcess server(TEST_FOLDER + "/mapped", options);
+            server.start();
+            RestartData data = writeRestartData();
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            server.crash();
+            
+            ServerProcess restarted(TEST_FOLDER + "/mapped", options);
+            restarted.start();
+            checkRestartData(data);
+            restarted.stop();
+            std::cout << "Blocks restored from the mapped pool" << std::endl;
+        }
+        {
+            // Changes after the checkpoint must not touch what it saved: everything is freed,
+            // new blocks are written and the compactor gets its chance before the crash.
+            // The only checkpoint is the one on shutdown, and the small pool makes the
+            // allocator pick the freed extents if it is allowed to
+            std::vector<std::string> options = {"--mapped-pool", "--checkpoint-interval-ms", "0"};
+            ServerProcess server(TEST_FOLDER + "/mapped_reuse", options, 1);
+            server.start();
+            RestartData data = writeRestartData();
+            server.stop();
+            
+            ServerProcess reused(TEST_FOLDER + "/mapped_reuse", options, 1);
+            reused.start();
+            for (int id : data.values) {
+                MemoryManagerClient::DecreaseRefCount(id);
+            }
+            MemoryManagerClient::DecreaseRefCount(data.large);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            
+            int overwrite = -1;
+            for (int i = 0; i < 50; i++) {
+                int id = MemoryManagerClient::Create(sizeof(int), "int");
+                check(id != -1 && MemoryManagerClient::Set(id, &overwrite, sizeof(overwrite)), "Failed to write an int block");
+            }
+            std::vector<char> filler(64 * 1024, static_cast<char>(0xee));
+            for (int i = 0; i < 4; i++) {
+                int id = MemoryManagerClient::Create(filler.size(), "bytes");
+                check(id != -1 && MemoryManagerClient::Set(id, filler.data(), filler.size()), "Failed to write a filler block");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            reused.crash();
+            
+            ServerProcess restarted(TEST_FOLDER + "/mapped_reuse", options, 1);
+            restarted.start();
+            checkRestartData(data);
+            restarted.stop();
+            std::cout << "Changes after the checkpoint left the saved blocks intact" << std::endl;
+        }
+        
+        std::cout << "\n=== TEST 5: WRITE-AHEAD LOG RECOVERY ===\n";
+        {
+            // Killed right after the last acknowledged change, before any checkpoint
+            std::vector<std::string> options = {"--wal", "per-op", "--wal-checkpoint-interval-ms", "0"};
+            ServerProcess server(TEST_FOLDER + "/wal", options);
+            server.start();
+            RestartData data = writeRestartData();
+            server.crash();
+            
+            ServerProcess restarted(TEST_FOLDER + "/wal", options);
+            restarted.start();
+            checkRestartData(data);
+            restarted.stop();
+            std::cout << "Blocks replayed from the log" << std::endl;
+        }
+        
+        std::cout << "Test completed successfully" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
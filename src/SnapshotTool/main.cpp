@@ -0,0 +1,37 @@
+#include "../../include/Snapshot.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " SNAPSHOT_FILE [OUTPUT_FILE]" << std::endl;
+    std::cout << "  SNAPSHOT_FILE: Binary snapshot written by the Memory Manager" << std::endl;
+    std::cout << "  OUTPUT_FILE: Text file in the memory dump layout (default: standard output)" << std::endl;
+}
+
+// Converts a binary snapshot to the human-readable memory dump layout
+int main(int argc, char* argv[]) {
+    if (argc != 2 && argc != 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Only the block table is needed, the pool contents are skipped
+    Snapshot snapshot;
+    if (!snapshot.load(argv[1], nullptr, 0)) {
+        return 1;
+    }
+
+    if (argc == 2) {
+        snapshot.writeText(std::cout);
+        return 0;
+    }
+
+    std::ofstream output(argv[2]);
+    if (!output) {
+        std::cerr << "Failed to create output file: " << argv[2] << std::endl;
+        return 1;
+    }
+    snapshot.writeText(output);
+    return 0;
+}
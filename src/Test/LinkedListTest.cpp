@@ -1,6 +1,10 @@
 #include "../../include/LinkedList.h"
+#include "../../include/UnrolledLinkedList.h"
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 // Test the LinkedList implementation
 int main() {
@@ -55,6 +59,28 @@ int main() {
             std::cout << "Final list: ";
             intList.print();
             
+            // Iterators read the nodes in bulk and work with the standard algorithms
+            int sum = 0;
+            for (int element : intList) {
+                sum += element;
+            }
+            auto last = std::prev(intList.end());
+            if (sum != 66 || *last != 30 || *std::prev(last) != 20 ||
+                std::count(intList.begin(), intList.end(), 5) != 1) {
+                throw std::runtime_error("Iteration returned the wrong elements");
+            }
+            std::cout << "Sum of the elements: " << sum << std::endl;
+            
+            // Bulk construction from a range, in a single request
+            std::vector<int> values = {2, 4, 6, 8};
+            LinkedList<int> bulkList(values.begin(), values.end());
+            bulkList.assign(values.rbegin(), values.rend());
+            int third;
+            if (!bulkList.get(2, third) || third != 4 || !std::equal(bulkList.begin(), bulkList.end(), values.rbegin())) {
+                throw std::runtime_error("Bulk construction stored the wrong elements");
+            }
+            bulkList.print();
+            
             // Get element at index 2
             int value;
             if (intList.get(2, value)) {
@@ -79,6 +105,13 @@ int main() {
             std::cout << "After clearing the list: ";
             intList.print();
             
+            // Stepping back from begin() or from the end of an empty list gives end()
+            LinkedList<int> neverUsed;
+            if (std::prev(intList.end()) != intList.end() || std::prev(neverUsed.end()) != neverUsed.end() ||
+                std::prev(bulkList.begin()) != bulkList.end()) {
+                throw std::runtime_error("Stepped back past the start of a list");
+            }
+            
             // Test with strings
             std::cout << "\n=== TEST 4: STRING LIST ===\n";
             std::cout << "Creating LinkedList<std::string>..." << std::endl;
@@ -92,9 +125,87 @@ int main() {
                 
                 std::cout << "String list: ";
                 stringList.print();
+                
+                // Indexed access goes straight to the node, also after popping the head
+                std::string word;
+                stringList.set(2, "Lists");
+                stringList.popFront();
+                if (!stringList.get(1, word) || word != "Lists") {
+                    throw std::runtime_error("Indexed access returned the wrong element");
+                }
+                std::cout << "Element at index 1: " << word << std::endl;
             } // Asegura que stringList se destruya antes de Cleanup()
+            
+            // Unrolled list: several elements per block
+            std::cout << "\n=== TEST 5: UNROLLED LIST ===\n";
+            {
+                UnrolledLinkedList<int, 4> unrolledList;
+                
+                std::cout << "Adding elements..." << std::endl;
+                for (int i = 1; i <= 10; i++) {
+                    unrolledList.pushBack(i * 10);
+                }
+                unrolledList.pushFront(5);
+                unrolledList.popFront();
+                unrolledList.popFront();
+                unrolledList.set(4, 55);
+                
+                std::cout << "Unrolled list: ";
+                unrolledList.print();
+                
+                int element;
+                int sum = 0;
+                for (int value : unrolledList) {
+                    sum += value;
+                }
+                if (!unrolledList.get(4, element) || element != 55 || sum != 535) {
+                    throw std::runtime_error("Unrolled list returned the wrong elements");
+                }
+                std::cout << "Sum of the elements: " << sum << std::endl;
+            }
         } // Asegura que todas las listas se destruyan antes de Cleanup()
         
+        // A list handle overwritten by a client must be rejected, not trusted
+        std::cout << "\n=== TEST 6: CORRUPTED LIST HANDLE ===\n";
+        {
+            int listId = MemoryManagerClient::ListCreate(sizeof(Node<int>), offsetof(Node<int>, nextId),
+                                                         offsetof(Node<int>, prevId), "corrupted");
+            char zeros[16] = {};
+            if (listId == -1 || !MemoryManagerClient::SetRange(listId, 0, zeros, sizeof(zeros))) {
+                throw std::runtime_error("Failed to set up the corrupted list");
+            }
+            
+            Node<int> node;
+            std::vector<int> ids;
+            Protocol::ListState state;
+            if (MemoryManagerClient::ListAppend(listId, &node, sizeof(node), 1, ids, state) != -1 ||
+                MemoryManagerClient::ListPushBack(listId, &node, sizeof(node), state) != -1) {
+                throw std::runtime_error("A corrupted list handle was accepted");
+            }
+            
+            // The server is still there for everybody else
+            if (!MemoryManagerClient::DecreaseRefCount(listId)) {
+                throw std::runtime_error("Memory Manager stopped answering");
+            }
+            std::cout << "Corrupted list handle rejected" << std::endl;
+            
+            // A traversal may only start at a node of the list's type
+            int goodList = MemoryManagerClient::ListCreate(sizeof(Node<int>), offsetof(Node<int>, nextId),
+                                                           offsetof(Node<int>, prevId), "Node<int>");
+            int nodeId = MemoryManagerClient::ListPushBack(goodList, &node, sizeof(node), state);
+            int foreignId = MemoryManagerClient::Create(sizeof(Node<int>), "int");
+            std::vector<char> nodes;
+            if (nodeId == -1 || foreignId == -1 || !MemoryManagerClient::Set(foreignId, &node, sizeof(node)) ||
+                MemoryManagerClient::ListTraverse(goodList, nodeId, false, 16, sizeof(node), ids, nodes) != 1 ||
+                MemoryManagerClient::ListTraverse(goodList, foreignId, false, 16, sizeof(node), ids, nodes) != -1) {
+                throw std::runtime_error("A traversal walked a block that is not a node of the list");
+            }
+            MemoryManagerClient::ListClear(goodList, state);
+            MemoryManagerClient::DecreaseRefCount(goodList);
+            MemoryManagerClient::DecreaseRefCount(foreignId);
+            std::cout << "Traversal from a foreign block rejected" << std::endl;
+        }
+        
         // Cleanup - llamado después de que todas las listas se han destruido
         std::cout << "\nCleaning up..." << std::endl;
         MemoryManagerClient::Cleanup();